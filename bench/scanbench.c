@@ -0,0 +1,192 @@
+/*
+ * This file is part of Colm.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Scanner benchmark driver. Generates an input of the requested size, then
+ * runs the program compiled from a benchmark grammar over it and reports the
+ * rate. BENCH_OBJECT names the program object, given to colm with -b.
+ * BENCH_KIND is parse for a full grammar and scan for one that ignores every
+ * token, so the rates of the two are reported apart.
+ *
+ * usage: bench_<grammar>_<mode> [megabytes] [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <colm/colm.h>
+
+#define STR2( s ) #s
+#define STR( s ) STR2( s )
+
+extern struct colm_sections BENCH_OBJECT;
+
+static const char *keywords[] = {
+	"auto", "break", "case", "char", "const", "continue", "default", "do",
+	"double", "else", "enum", "extern", "float", "for", "goto", "if", "int",
+	"long", "register", "return", "short", "signed", "sizeof", "static",
+	"struct", "switch", "typedef", "union", "unsigned", "void", "volatile",
+	"while"
+};
+
+#define NUM_KEYWORDS ( sizeof(keywords) / sizeof(keywords[0]) )
+
+static const char syms[] = "(){};,=+-*<>";
+static const char ident_first[] =
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+static const char ident_rest[] =
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+
+/* Fixed generator so every run and mode sees the same input. */
+static unsigned long rand_state = 1;
+
+static unsigned long next_rand()
+{
+	rand_state = rand_state * 6364136223846793005UL + 1442695040888963407UL;
+	return rand_state >> 33;
+}
+
+/* Writes about size bytes of keywords, identifiers, numbers, strings,
+ * symbols and comments. Returns the number of tokens written. Comments and
+ * whitespace are ignored by the grammars and not counted. */
+static long gen_input( FILE *file, long size )
+{
+	long written = 0, tokens = 0, i, len;
+	int col = 0;
+
+	while ( written < size ) {
+		unsigned long kind = next_rand() % 100;
+
+		if ( kind < 25 ) {
+			const char *kw = keywords[next_rand() % NUM_KEYWORDS];
+			written += fprintf( file, "%s", kw );
+		}
+		else if ( kind < 55 ) {
+			len = 1 + next_rand() % 12;
+			fputc( ident_first[next_rand() % ( sizeof(ident_first) - 1 )], file );
+			for ( i = 1; i < len; i++ )
+				fputc( ident_rest[next_rand() % ( sizeof(ident_rest) - 1 )], file );
+			written += len;
+		}
+		else if ( kind < 70 ) {
+			written += fprintf( file, "%lu", next_rand() % 100000 );
+			if ( next_rand() % 4 == 0 )
+				written += fprintf( file, ".%lu", next_rand() % 1000 );
+		}
+		else if ( kind < 78 ) {
+			len = next_rand() % 40;
+			fputc( '"', file );
+			for ( i = 0; i < len; i++ ) {
+				if ( next_rand() % 16 == 0 ) {
+					fputs( "\\\"", file );
+					written += 1;
+				}
+				else {
+					fputc( ident_rest[next_rand() % ( sizeof(ident_rest) - 1 )], file );
+				}
+			}
+			fputc( '"', file );
+			written += len + 2;
+		}
+		else if ( kind < 98 ) {
+			fputc( syms[next_rand() % ( sizeof(syms) - 1 )], file );
+			written += 1;
+		}
+		else {
+			written += fprintf( file, "// comment %lu\n", next_rand() );
+			col = 0;
+			continue;
+		}
+
+		tokens += 1;
+
+		/* Separate with whitespace, breaking lines now and then. */
+		col += 1;
+		if ( col > 12 ) {
+			fputc( '\n', file );
+			col = 0;
+		}
+		else {
+			fputc( ' ', file );
+		}
+		written += 1;
+	}
+
+	return tokens;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main( int argc, const char **argv )
+{
+	long megabytes = argc > 1 ? atol( argv[1] ) : 16;
+	int runs = argc > 2 ? atoi( argv[2] ) : 3;
+	const char *fn = STR( BENCH_OBJECT ) ".in";
+	const char *prg_argv[3] = { STR( BENCH_OBJECT ), fn, 0 };
+	double best = 0;
+	long size, tokens;
+	FILE *file;
+	int r;
+
+	if ( megabytes <= 0 || runs <= 0 ) {
+		fprintf( stderr, "usage: %s [megabytes] [runs]\n", argv[0] );
+		return 1;
+	}
+
+	file = fopen( fn, "w" );
+	if ( file == 0 ) {
+		fprintf( stderr, "%s: could not open %s\n", argv[0], fn );
+		return 1;
+	}
+
+	tokens = gen_input( file, megabytes * 1024 * 1024 );
+	size = ftell( file );
+	fclose( file );
+
+	for ( r = 0; r < runs; r++ ) {
+		struct colm_program *prg;
+		double start, elapsed;
+
+		start = now();
+		prg = colm_new_program( &BENCH_OBJECT );
+		colm_run_program( prg, 2, prg_argv );
+		colm_delete_program( prg );
+		elapsed = now() - start;
+
+		if ( r == 0 || elapsed < best )
+			best = elapsed;
+	}
+
+	printf( "%-5s %-20s %8ld bytes %8ld tokens %8.3f s %8.1f MB/s %8.2f Mtok/s\n",
+			STR( BENCH_KIND ), STR( BENCH_OBJECT ), size, tokens, best,
+			size / best / ( 1024 * 1024 ), tokens / best / 1e6 );
+
+	remove( fn );
+	return 0;
+}
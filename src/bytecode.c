@@ -146,6 +146,19 @@ static void flush_streams( program_t *prg )
 	}
 }
 
+/* File streams buffer their output, which exit() does not know about. */
+static void flush_all_streams( program_t *prg )
+{
+	struct colm_struct *s;
+	for ( s = prg->heap.head; s != 0; s = s->next ) {
+		if ( s->id == prg->rtd->struct_stream_id ) {
+			struct stream_impl *si = ((stream_t*)s)->impl;
+			if ( si != 0 )
+				si->funcs->flush_stream( prg, si );
+		}
+	}
+}
+
 void colm_parser_set_context( program_t *prg, tree_t **sp, parser_t *parser, struct_t *val )
 {
 	parser->pda_run->context = val;
@@ -263,6 +276,8 @@ static word_t stream_append_stream( program_t *prg, tree_t **sp, input_t *dest,
 static void stream_undo_append( program_t *prg, tree_t **sp,
 		struct input_impl *is, tree_t *input, long length )
 {
+	prg->input_changes += 1;
+
 	if ( input->id == LEL_ID_PTR )
 		assert(false);
 	else if ( input->id == LEL_ID_STR )
@@ -275,6 +290,7 @@ static void stream_undo_append( program_t *prg, tree_t **sp,
 static void stream_undo_append_stream( program_t *prg, tree_t **sp, struct input_impl *is,
 		tree_t *input, long length )
 {
+	prg->input_changes += 1;
 	is->funcs->undo_append_stream( prg, is );
 }
 
@@ -291,6 +307,7 @@ static tree_t *stream_pull_bc( program_t *prg, tree_t **sp, struct pda_run *pda_
 static void undo_stream_pull( struct colm_program *prg, struct input_impl *is, const char *data, long length )
 {
 	//debug( REALM_PARSE, "undoing stream pull\n" );
+	prg->input_changes += 1;
 	is->funcs->undo_consume_data( prg, is, data, length );
 }
 
@@ -626,6 +643,101 @@ tree_t *colm_run_func( struct colm_program *prg, int frame_id,
 	return prg->return_val;
 };
 
+/*
+ * Push parsing. The parser is run over whatever input it has been given, as
+ * a send statement would, with reduction and generation actions called from
+ * the VM. Running out of input leaves the scanner and parser waiting for
+ * more.
+ */
+
+static code_t push_parse_code[] = { IN_PARSE_FRAG_W, IN_FN, FN_STOP };
+
+static int push_parse( program_t *prg, parser_t *parser )
+{
+	execution_t execution;
+	memset( &execution, 0, sizeof(execution) );
+	execution.frame_id = -1;
+	execution.steps = parser->pda_run->steps;
+	execution.pcr = PCR_START;
+
+	tree_t **sp = prg->stack_root;
+	vm_push_parser( parser );
+
+	sp = colm_execute_code( prg, &execution, sp, push_parse_code );
+
+	vm_pop_parser();
+	prg->stack_root = sp;
+
+	return parser->pda_run->parse_error ? COLM_PUSH_ERROR : COLM_PUSH_MORE;
+}
+
+struct colm_parser *colm_push_new( struct colm_program *prg, const char *name )
+{
+	long g;
+	for ( g = 0; g < prg->rtd->num_generics; g++ ) {
+		struct generic_info *gi = &prg->rtd->generic_info[g];
+		if ( gi->type == GEN_PARSER ) {
+			long lel_id = prg->rtd->parser_lel_ids[gi->parser_id];
+			if ( strcmp( prg->rtd->lel_info[lel_id].name, name ) == 0 )
+				return (parser_t*) colm_construct_generic( prg, g, 0 );
+		}
+	}
+	return 0;
+}
+
+int colm_push_data( struct colm_program *prg, struct colm_parser *parser,
+		const char *data, long length )
+{
+	if ( parser->pda_run->parse_error )
+		return COLM_PUSH_ERROR;
+
+	struct input_impl *si = input_to_impl( parser->input );
+	si->funcs->append_data( prg, si, data, length );
+
+	return push_parse( prg, parser );
+}
+
+int colm_push_finish( struct colm_program *prg, struct colm_parser *parser )
+{
+	if ( parser->pda_run->parse_error )
+		return COLM_PUSH_ERROR;
+
+	struct input_impl *si = input_to_impl( parser->input );
+	si->funcs->set_eof_mark( prg, si, true );
+
+	return push_parse( prg, parser ) == COLM_PUSH_ERROR ?
+			COLM_PUSH_ERROR : COLM_PUSH_DONE;
+}
+
+struct colm_tree *colm_push_result( struct colm_program *prg, struct colm_parser *parser )
+{
+	return get_parser_mem( parser, 0 );
+}
+
+const char *colm_push_error( struct colm_program *prg, struct colm_parser *parser, int *length )
+{
+	tree_t *error = get_parser_mem( parser, 1 );
+	if ( error == 0 )
+		return 0;
+
+	if ( length != 0 )
+		*length = error->tokdata->length;
+	return error->tokdata->data;
+}
+
+/* Parsers normally live until the program ends. Push parsers are taken off
+ * the heap along with their input. */
+void colm_push_delete( struct colm_program *prg, struct colm_parser *parser )
+{
+	struct colm_struct *input = (struct colm_struct*) parser->input;
+
+	colm_struct_detach( prg, (struct colm_struct*) parser );
+	colm_struct_delete( prg, prg->stack_root, (struct colm_struct*) parser );
+
+	colm_struct_detach( prg, input );
+	colm_struct_delete( prg, prg->stack_root, input );
+}
+
 int colm_make_reverse_code( struct pda_run *pda_run )
 {
 	struct rt_code_vect *reverse_code = &pda_run->reverse_code;
@@ -2337,7 +2449,7 @@ again:
 			else if ( trim == TRIM_NO )
 				auto_trim = false;
 			else 
-				auto_trim = si->funcs->get_option( prg, si, 0 );
+				auto_trim = si->funcs->get_option( prg, si, STREAM_OPT_AUTO_TRIM );
 
 			si->funcs->print_tree( prg, sp, si, to_send, auto_trim );
 			vm_push_stream( stream );
@@ -2362,7 +2474,7 @@ again:
 			else if ( trim == TRIM_NO )
 				auto_trim = false;
 			else 
-				auto_trim = si->funcs->get_option( prg, si, 0 );
+				auto_trim = si->funcs->get_option( prg, si, STREAM_OPT_AUTO_TRIM );
 
 			word_t len = stream_append_text( prg, sp, parser->input, to_send, auto_trim );
 
@@ -2418,7 +2530,7 @@ again:
 			else if ( trim == TRIM_NO )
 				auto_trim = false;
 			else 
-				auto_trim = si->funcs->get_option( prg, si, 0 );
+				auto_trim = si->funcs->get_option( prg, si, STREAM_OPT_AUTO_TRIM );
 
 			if ( auto_trim )
 				to_send = tree_trim( prg, sp, to_send );
@@ -2558,7 +2670,31 @@ again:
 			value_t auto_trim = vm_pop_value();
 			struct stream_impl *si = stream->impl;
 
-			si->funcs->set_option( prg, si, 0, (long) auto_trim );
+			si->funcs->set_option( prg, si, STREAM_OPT_AUTO_TRIM, (long) auto_trim );
+
+			vm_push_stream( stream );
+			break;
+		}
+		case IN_INPUT_BLOCK_SIZE_WC: {
+			debug( prg, REALM_BYTECODE, "IN_INPUT_BLOCK_SIZE_WC\n" );
+
+			stream_t *stream = vm_pop_stream();
+			value_t block_size = vm_pop_value();
+			struct stream_impl *si = stream->impl;
+
+			si->funcs->set_option( prg, si, STREAM_OPT_BLOCK_SIZE, (long) block_size );
+
+			vm_push_stream( stream );
+			break;
+		}
+		case IN_INPUT_READ_AHEAD_WC: {
+			debug( prg, REALM_BYTECODE, "IN_INPUT_READ_AHEAD_WC\n" );
+
+			stream_t *stream = vm_pop_stream();
+			value_t blocks = vm_pop_value();
+			struct stream_impl *si = stream->impl;
+
+			si->funcs->set_option( prg, si, STREAM_OPT_READ_AHEAD, (long) blocks );
 
 			vm_push_stream( stream );
 			break;
@@ -2570,7 +2706,7 @@ again:
 			value_t auto_trim = vm_pop_value();
 			struct input_impl *ii = input->impl;
 
-			ii->funcs->set_option( prg, ii, 0, (long) auto_trim );
+			ii->funcs->set_option( prg, ii, STREAM_OPT_AUTO_TRIM, (long) auto_trim );
 
 			vm_push_input( input );
 			break;
@@ -3158,8 +3294,10 @@ again:
 
 			tree_t *tree = vm_pop_tree();
 			value_t integer = 0;
-			if ( tree->tokdata->location )
+			if ( tree->tokdata->location ) {
+				colm_location_resolve( tree->tokdata->location );
 				integer = tree->tokdata->location->line;
+			}
 			vm_push_value( integer );
 			colm_tree_downref( prg, sp, tree );
 			break;
@@ -3169,8 +3307,10 @@ again:
 
 			tree_t *tree = vm_pop_tree();
 			value_t integer = 0;
-			if ( tree->tokdata->location )
+			if ( tree->tokdata->location ) {
+				colm_location_resolve( tree->tokdata->location );
 				integer = tree->tokdata->location->column;
+			}
 			vm_push_value( integer );
 			colm_tree_downref( prg, sp, tree );
 			break;
@@ -3351,6 +3491,30 @@ again:
 			vm_push_input( parser->input );
 			break;
 		}
+		case IN_PARSER_NO_LOCATIONS_WC: {
+			debug( prg, REALM_BYTECODE, "IN_PARSER_NO_LOCATIONS_WC\n" );
+
+			parser_t *parser = vm_pop_parser();
+			value_t no_locations = vm_pop_value();
+
+			parser->pda_run->no_locations = no_locations ? 1 : 0;
+
+			vm_push_parser( parser );
+			break;
+		}
+		case IN_PARSER_AUTO_COMMIT_WC: {
+			debug( prg, REALM_BYTECODE, "IN_PARSER_AUTO_COMMIT_WC\n" );
+
+			parser_t *parser = vm_pop_parser();
+			value_t auto_commit = vm_pop_value();
+			struct pda_run *pda_run = parser->pda_run;
+
+			pda_run->auto_commit = (long) auto_commit;
+			pda_run->auto_commit_at = pda_run->position + pda_run->auto_commit;
+
+			vm_push_parser( parser );
+			break;
+		}
 		case IN_GET_PARSER_MEM_R: {
 			short field;
 			read_half( field );
@@ -4566,6 +4730,7 @@ again:
 				vm_pop_tree();
 				prg->exit_status = vm_pop_type(long);
 				prg->induce_exit = 1;
+				flush_all_streams( prg );
 				exit( prg->exit_status );
 			}
 			case FN_EXIT: {
@@ -253,6 +253,8 @@ typedef unsigned char uchar;
 #define IN_INPUT_CLOSE_WC        0xef
 #define IN_INPUT_AUTO_TRIM_WC    0x82
 #define IN_IINPUT_AUTO_TRIM_WC   0x83
+#define IN_INPUT_BLOCK_SIZE_WC   0x85
+#define IN_INPUT_READ_AHEAD_WC   0x86
 
 #define IN_PARSE_FRAG_W          0xa2
 #define IN_PARSE_INIT_BKT        0xa1
@@ -320,6 +322,8 @@ typedef unsigned char uchar;
 #define IN_GET_STREAM_MEM_R      0xb7
 
 #define IN_GET_PARSER_STREAM     0x6b
+#define IN_PARSER_NO_LOCATIONS_WC  0x84
+#define IN_PARSER_AUTO_COMMIT_WC   0xa7
 
 #define IN_GET_ERROR             0xcc
 #define IN_SET_ERROR             0xe2
@@ -634,6 +638,7 @@ const char *string_data( head_t *str );
 head_t *init_str_space( long length );
 head_t *string_copy( struct colm_program *prg, head_t *head );
 void string_free( struct colm_program *prg, head_t *head );
+void string_pin( head_t *head, struct run_buf *run_buf );
 void string_shorten( head_t *tokdata, long newlen );
 head_t *concat_str( head_t *s1, head_t *s2 );
 word_t str_atoi( head_t *str );
@@ -52,7 +52,22 @@ void FsmCodeGen::writeMain( long activeRealm )
 		"	int exit_status;\n"
 		"\n"
 		"	prg = colm_new_program( &" << objectName << " );\n"
-		"	colm_set_debug( prg, " << activeRealm << " );\n"
+		"	colm_set_debug( prg, " << activeRealm << " );\n";
+
+	if ( btProfileFn != 0 ) {
+		out << "	colm_set_bt_profile( prg, \"";
+		for ( const char *pc = btProfileFn; *pc != 0; pc++ ) {
+			if ( *pc == '\\' || *pc == '"' )
+				out << '\\';
+			out << *pc;
+		}
+		out << "\" );\n";
+	}
+
+	if ( btMemo )
+		out << "	colm_set_bt_memo( prg, 1 );\n";
+
+	out <<
 		"	colm_run_program( prg, argc, argv );\n"
 		"	exit_status = colm_delete_program( prg );\n"
 		"	return exit_status;\n"
@@ -103,10 +103,16 @@ void colm_rt_code_vect_empty( struct rt_code_vect *vect )
 	}
 }
 
+/* Make room for len elements in total. Does not change tab_len. */
+void colm_rt_code_vect_grow( struct rt_code_vect *vect, long len )
+{
+	up_resize( vect, len );
+}
+
 void colm_rt_code_vect_replace( struct rt_code_vect *vect, long pos,
 		const code_t *val, long len )
 {
-	long end_pos, i;
+	long end_pos;
 	//code_t *item;
 
 	/* If we are given a negative position to replace at then
@@ -137,11 +143,8 @@ void colm_rt_code_vect_replace( struct rt_code_vect *vect, long pos,
 		//	item->~code_t();
 	}
 
-	/* Copy data in using copy constructor. */
-	code_t *dst = vect->data + pos;
-	const code_t *src = val;
-	for ( i = 0; i < len; i++, dst++, src++ )
-		*dst = *src;
+	/* Copy data in. */
+	memcpy( vect->data + pos, val, sizeof(code_t) * len );
 }
 
 void colm_rt_code_vect_remove( struct rt_code_vect *vect, long pos, long len )
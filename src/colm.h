@@ -34,6 +34,7 @@ struct colm_program;
 struct colm_sections;
 struct colm_tree;
 struct colm_location;
+struct colm_parser;
 
 struct indent_impl
 {
@@ -133,6 +134,23 @@ void colm_run_program2( struct colm_program *prg, int argc, const char **argv, c
 struct colm_tree *colm_run_func( struct colm_program *prg, int frame_id,
 		const char **params, int param_count );
 
+/* Push parsing, for hosts that receive input in pieces. Create a parser for
+ * a type the program declares a parser for, by name. Data is parsed as far
+ * as it goes and the parser then waits for more, so many parsers can be fed
+ * from one event loop. Finishing sends the end of input. The result tree
+ * belongs to the parser and is valid until it is deleted. */
+#define COLM_PUSH_MORE  1
+#define COLM_PUSH_DONE  2
+#define COLM_PUSH_ERROR 3
+
+struct colm_parser *colm_push_new( struct colm_program *prg, const char *name );
+int colm_push_data( struct colm_program *prg, struct colm_parser *parser,
+		const char *data, long length );
+int colm_push_finish( struct colm_program *prg, struct colm_parser *parser );
+struct colm_tree *colm_push_result( struct colm_program *prg, struct colm_parser *parser );
+const char *colm_push_error( struct colm_program *prg, struct colm_parser *parser, int *length );
+void colm_push_delete( struct colm_program *prg, struct colm_parser *parser );
+
 /* Delete a colm program. Clears all memory. */
 int colm_delete_program( struct colm_program *prg );
 
@@ -141,8 +159,80 @@ void *colm_get_reduce_ctx( struct colm_program *prg );
 void colm_set_reduce_ctx( struct colm_program *prg, void *ctx );
 void colm_set_reduce_clean( struct colm_program *prg, unsigned char reduce_clean );
 
+/* Keep only the byte offset in token locations and compute line and column
+ * when asked for. Streams record newline offsets instead. Applies to streams
+ * that have not yet consumed any data. */
+void colm_set_lazy_locations( struct colm_program *prg, int lazy_locations );
+
+/* Parsers created after this keep no token locations and streams stop
+ * tracking lines. Individual parsers can also opt out with no_locations(). */
+void colm_set_no_locations( struct colm_program *prg, int no_locations );
+
+/* Count the backtracking of parsers per parser state and per production.
+ * A report ordered by the work done is written to file when the program is
+ * deleted, or to stderr if file is null. */
+void colm_set_bt_profile( struct colm_program *prg, const char *file );
+
+/* Parsers created after this commit on their own whenever they have taken
+ * auto_commit bytes of input since the last time and have no alternatives
+ * left to try. Keeps memory flat for grammars without commit points.
+ * Individual parsers can set it with auto_commit(). Zero turns it off. */
+void colm_set_auto_commit( struct colm_program *prg, long auto_commit );
+
+/* Parsers created after this remember the alternatives that failed at an
+ * input position and skip them when they come to the same point with the
+ * same stack. Applies until the parser commits. */
+void colm_set_bt_memo( struct colm_program *prg, int bt_memo );
+
 const char *colm_error( struct colm_program *prg, int *length );
 
+/* Input buffer recycling. Allocated and reused count requests, released
+ * counts buffers freed because the pool was full. Pooled and high water are
+ * in bytes. Pinned is the number of consumed buffers kept alive by tokens
+ * that point into them. */
+struct colm_run_buf_stats
+{
+	long allocated;
+	long reused;
+	long released;
+	long pooled;
+	long high_water;
+	long pinned;
+};
+
+void colm_run_buf_stats( struct colm_program *prg, struct colm_run_buf_stats *stats );
+
+/* Sequence buffers taken from the program's pool by input sequences and the
+ * number still held. The high water marks are the longest queue of sources
+ * any input had and the most buffers stashed for undoing consumption. */
+struct colm_input_stats
+{
+	long seq_bufs;
+	long seq_bufs_live;
+	long queue_high_water;
+	long stash_high_water;
+};
+
+void colm_input_stats( struct colm_program *prg, struct colm_input_stats *stats );
+
+/* Work done by the inputs of a program, summed over live and finished
+ * streams. Reads are calls on a source for more data, such as read() on a
+ * file. Copied bytes went from the input into token data, and tokens
+ * crossing buffers or sources are among them because their data was not in
+ * one place. */
+struct colm_input_counters
+{
+	long bytes_read;
+	long reads;
+	long run_bufs;
+	long undo_bytes;
+	long copied_bytes;
+	long crossing_buffers;
+	long crossing_sources;
+};
+
+void colm_input_counters( struct colm_program *prg, struct colm_input_counters *counters );
+
 const char **colm_extract_fns( struct colm_program *prg );
 
 #ifdef __cplusplus
@@ -87,6 +87,20 @@ static int been_committed( parse_tree_t *parse_tree )
 	return parse_tree->flags & PF_COMMITTED;
 }
 
+/* Without a reducer nothing reads the committed parse trees. Only the root
+ * level of the stack is kept, for its tree shadows. */
+void commit_clear( program_t *prg, tree_t **root, struct pda_run *pda_run )
+{
+	parse_tree_t *pt = pda_run->stack_top;
+	while ( pt != 0 && !been_committed( pt ) ) {
+		commit_clear_parse_tree( prg, root, pda_run, pt->child );
+		pt->child = 0;
+
+		pt->flags |= PF_COMMITTED;
+		pt = pt->next;
+	}
+}
+
 void commit_reduce( program_t *prg, tree_t **root, struct pda_run *pda_run )
 {
 	tree_t **sp = root;
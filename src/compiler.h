@@ -710,6 +710,7 @@ struct Compiler
 	void lalr1GenerateParser( PdaGraph *pdaGraph, LangElSet &parserEls );
 
 	void reduceActions( PdaGraph *pdaGraph );
+	void defaultReductions( PdaGraph *pdaGraph );
 
 	bool makeNonTermFirstSetProd( Production *prod, PdaState *state );
 	void makeNonTermFirstSets();
@@ -769,6 +770,7 @@ struct Compiler
 	void makeParser( LangElSet &parserEls );
 	PdaGraph *makePdaGraph( BstSet<LangEl*> &parserEls  );
 	struct pda_tables *makePdaTables( PdaGraph *pdaGraph );
+	void printTableStats( PdaGraph *pdaGraph, struct pda_tables *pdaTables );
 
 	void fillInPatterns( program_t *prg );
 	void makeRuntimeData();
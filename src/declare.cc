@@ -917,6 +917,12 @@ void Compiler::declareStreamFields( )
 	initFunction( uniqueTypeVoid, streamObj, ObjectMethod::Call, "auto_trim",
 			IN_INPUT_AUTO_TRIM_WC, IN_INPUT_AUTO_TRIM_WC, uniqueTypeBool, false );
 
+	initFunction( uniqueTypeVoid, streamObj, ObjectMethod::Call, "block_size",
+			IN_INPUT_BLOCK_SIZE_WC, IN_INPUT_BLOCK_SIZE_WC, uniqueTypeInt, false );
+
+	initFunction( uniqueTypeVoid, streamObj, ObjectMethod::Call, "read_ahead",
+			IN_INPUT_READ_AHEAD_WC, IN_INPUT_READ_AHEAD_WC, uniqueTypeInt, false );
+
 	declareStreamField( streamObj, 0 );
 }
 
@@ -1494,6 +1500,12 @@ void Compiler::initParserFunctions( GenericType *gen )
 
 	initFunction( uniqueTypeInput, gen->objDef, ObjectMethod::Call, "gets",
 			IN_GET_PARSER_STREAM, IN_GET_PARSER_STREAM, true );
+
+	initFunction( uniqueTypeVoid, gen->objDef, ObjectMethod::Call, "no_locations",
+			IN_PARSER_NO_LOCATIONS_WC, IN_PARSER_NO_LOCATIONS_WC, uniqueTypeBool, false );
+
+	initFunction( uniqueTypeVoid, gen->objDef, ObjectMethod::Call, "auto_commit",
+			IN_PARSER_AUTO_COMMIT_WC, IN_PARSER_AUTO_COMMIT_WC, uniqueTypeInt, false );
 }
 
 void Compiler::initParserField( GenericType *gen, const char *name,
@@ -26,6 +26,7 @@
 
 #include <sstream>
 #include <iostream>
+#include <fstream>
 
 #include "fsmcodegen.h"
 
@@ -460,6 +461,71 @@ void FsmCodeGen::emitSingleSwitch( RedState *state )
 	}
 }
 
+/* Writes a switch on the character class. The transition used by the most
+ * classes is left out and returned to be used as the default. */
+RedTrans *FsmCodeGen::emitClassSwitch( RedState *state )
+{
+	/* Find the transition for each class. */
+	RedTrans **classTrans = new RedTrans*[redFsm->numCharClasses];
+	for ( int c = 0; c < redFsm->numCharClasses; c++ )
+		classTrans[c] = redFsm->keyTrans( state, redFsm->classKey[c] );
+
+	/* Pick the default by the number of classes. */
+	RedTrans *defTrans = state->defTrans;
+	int maxClasses = 0;
+	for ( int c = 0; c < redFsm->numCharClasses; c++ ) {
+		int numClasses = 0;
+		for ( int o = 0; o < redFsm->numCharClasses; o++ ) {
+			if ( classTrans[o] == classTrans[c] )
+				numClasses += 1;
+		}
+		if ( numClasses > maxClasses ) {
+			maxClasses = numClasses;
+			defTrans = classTrans[c];
+		}
+	}
+
+	int numClasses = 0, lastClass = 0;
+	for ( int c = 0; c < redFsm->numCharClasses; c++ ) {
+		if ( classTrans[c] != defTrans ) {
+			numClasses += 1;
+			lastClass = c;
+		}
+	}
+
+	if ( numClasses == 1 ) {
+		/* If there is a single class then write it out as an if. */
+		out << "\tif ( " << CHAR_CLASS() << "[(unsigned char)" << GET_KEY() << "] == " <<
+				lastClass << " )\n\t\t";
+		STATE_TRANS_GOTO( state, classTrans[lastClass], 0 ) << "\n";
+	}
+	else if ( numClasses > 1 ) {
+		out << "\tswitch( " << CHAR_CLASS() << "[(unsigned char)" << GET_KEY() << "] ) {\n";
+
+		/* One line per target, with all the classes that go there. */
+		for ( int c = 0; c < redFsm->numCharClasses; c++ ) {
+			RedTrans *trans = classTrans[c];
+			if ( trans == 0 || trans == defTrans )
+				continue;
+
+			out << "\t";
+			for ( int o = c; o < redFsm->numCharClasses; o++ ) {
+				if ( classTrans[o] == trans ) {
+					out << "\tcase " << o << ":";
+					classTrans[o] = 0;
+				}
+			}
+			out << " ";
+			STATE_TRANS_GOTO( state, trans, 0 ) << "\n";
+		}
+
+		out << "\t}\n";
+	}
+
+	delete[] classTrans;
+	return defTrans;
+}
+
 void FsmCodeGen::emitRangeBSearch( RedState *state, int level, int low, int high )
 {
 	/* Get the mid position, staying on the lower end of the range. */
@@ -556,16 +622,25 @@ std::ostream &FsmCodeGen::STATE_GOTOS()
 			/* Writing code above state gotos. */
 			GOTO_HEADER( st );
 
-			/* Try singles. */
-			if ( st->outSingle.length() > 0 )
-				emitSingleSwitch( st );
-
-			/* Default case is to binary search for the ranges, if that fails then */
-			if ( st->outRange.length() > 0 )
-				emitRangeBSearch( st, 1, 0, st->outRange.length() - 1 );
-
-			/* Write the default transition. */
-			TRANS_GOTO( st->defTrans, 1 ) << "\n";
+			if ( redFsm->charClass != 0 ) {
+				/* Switch on the character class, then take the transition
+				 * common to the most classes. */
+				RedTrans *defTrans = emitClassSwitch( st );
+				STATE_TRANS_GOTO( st, defTrans, 1 ) << "\n";
+			}
+			else {
+				/* Try singles. */
+				if ( st->outSingle.length() > 0 )
+					emitSingleSwitch( st );
+
+				/* Default case is to binary search for the ranges, if that
+				 * fails then */
+				if ( st->outRange.length() > 0 )
+					emitRangeBSearch( st, 1, 0, st->outRange.length() - 1 );
+
+				/* Write the default transition. */
+				TRANS_GOTO( st->defTrans, 1 ) << "\n";
+			}
 		}
 	}
 	return out;
@@ -668,6 +743,14 @@ void FsmCodeGen::GOTO_HEADER( RedState *state )
 {
 	IN_TRANS_ACTIONS( state );
 
+	if ( state->loopOffset != 0 ) {
+		/* Reached on the state's own loop. Pass over the rest of the run. */
+		out <<
+			"sk" << state->id << ":\n"
+			"	" << P() << " = colm_skip_loop( " << P() << " + 1, " << PE() << ", " <<
+					LOOP_RANGES() << " + " << state->loopOffset << " ) - 1;\n";
+	}
+
 	if ( state->labelNeeded ) 
 		out << "st" << state->id << ":\n";
 
@@ -685,6 +768,9 @@ void FsmCodeGen::GOTO_HEADER( RedState *state )
 		"	if ( ++" << P() << " == " << PE() << " )\n"
 		"		goto out" << state->id << ";\n";
 
+	if ( profileWriteFn != 0 )
+		out << "	" << STATE_VISITS() << "[" << state->id << "] += 1;\n";
+
 	if ( state->fromStateAction != 0 ) {
 		/* Remember that we wrote an action. Write every action in the list. */
 		for ( GenActionTable::Iter item = state->fromStateAction->key; item.lte(); item++ )
@@ -728,6 +814,17 @@ std::ostream &FsmCodeGen::TRANS_GOTO( RedTrans *trans, int level )
 	return out;
 }
 
+/* Emit the goto for a transition taken from a given state. Self loops go
+ * through the skip ahead of the state. */
+std::ostream &FsmCodeGen::STATE_TRANS_GOTO( RedState *state, RedTrans *trans, int level )
+{
+	if ( trans->targ == state && trans->action == 0 && state->loopOffset != 0 )
+		out << TABS(level) << "goto sk" << state->id << ";";
+	else
+		TRANS_GOTO( trans, level );
+	return out;
+}
+
 std::ostream &FsmCodeGen::EXIT_STATES()
 {
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
@@ -767,6 +864,29 @@ void FsmCodeGen::setLabelsNeeded()
 		st->outNeeded = st->labelNeeded;
 }
 
+/* Write one of the interpreted scanner's tables as a static array. Returns
+ * the name for the initializer. */
+template <class T> string FsmCodeGen::TABLE( const char *type, string name,
+		const T *vals, long len )
+{
+	if ( len == 0 )
+		return "0";
+
+	out << "static " << type << " " << DATA_PREFIX() << name << "[] = {\n\t";
+	for ( long i = 0; i < len; i++ ) {
+		out << (long)vals[i];
+
+		if ( i < len-1 ) {
+			out << ", ";
+			if ( (i+1) % 8 == 0 )
+				out << "\n\t";
+		}
+	}
+	out << "\n};\n\n";
+
+	return DATA_PREFIX() + name;
+}
+
 void FsmCodeGen::writeData()
 {
 	out << "#define " << START() << " " << START_STATE_ID() << "\n";
@@ -788,32 +908,118 @@ void FsmCodeGen::writeData()
 	}
 	out << "\n};\n\n";
 
+	if ( redFsm->charClass != 0 ) {
+		out << "static unsigned char " << CHAR_CLASS() << "[] = {\n\t";
+		for ( int i = 0; i < 256; i++ ) {
+			out << (int)redFsm->charClass[i];
+
+			if ( i < 255 ) {
+				out << ", ";
+				if ( (i+1) % 16 == 0 )
+					out << "\n\t";
+			}
+		}
+		out << "\n};\n\n";
+	}
+
+	if ( profileWriteFn != 0 ) {
+		out << "static unsigned long " << STATE_VISITS() << "[" <<
+				redFsm->nextStateId << "];\n\n";
+	}
+
+	out << "static unsigned char " << LOOP_RANGES() << "[] = {\n\t";
+	for ( int i = 0; i < redFsm->loopRanges.length(); i++ ) {
+		out << (int)redFsm->loopRanges[i];
+
+		if ( i < redFsm->loopRanges.length()-1 ) {
+			out << ", ";
+			if ( (i+1) % 16 == 0 )
+				out << "\n\t";
+		}
+	}
+	out << "\n};\n\n";
+
+	/* The goto scanner uses only the region entries, character classes and
+	 * loops. Scanning from tables needs the rest. */
+	string actions = "0", keyOffsets = "0", transKeys = "0", singleLengths = "0",
+		rangeLengths = "0", indexOffsets = "0", transTargsWI = "0",
+		transActionsWI = "0", toStateActions = "0", fromStateActions = "0",
+		eofActions = "0", eofTargs = "0", actionCode = "0",
+		actionCodeOffsets = "0", lmSwitchTokens = "0", flatKeys = "0",
+		flatKeySpans = "0", flatIndexOffsets = "0", flatIndicies = "0",
+		flatTransTargs = "0", flatTransActions = "0", loopOffsets = "0";
+
+	long numStates = 0, numActions = 0, numTransKeys = 0, numTransTargsWI = 0,
+		numTransActionsWI = 0, numActionCode = 0, numLmSwitchTokens = 0,
+		numFlatIndicies = 0, numFlatTrans = 0;
+
+	if ( tableScanner ) {
+		fsm_tables *t = fsmTables;
+		numStates = t->num_states;
+		numActions = t->num_actions;
+		numTransKeys = t->num_trans_keys;
+		numTransTargsWI = t->numTransTargsWI;
+		numTransActionsWI = t->numTransActionsWI;
+		numActionCode = t->num_action_code;
+		numLmSwitchTokens = t->num_lm_switch_tokens;
+
+		actions = TABLE( "long", "actions", t->actions, numActions );
+		keyOffsets = TABLE( "long", "key_offsets", t->key_offsets, numStates );
+		transKeys = TABLE( "char", "trans_keys", t->trans_keys, numTransKeys );
+		singleLengths = TABLE( "long", "single_lengths", t->single_lengths, numStates );
+		rangeLengths = TABLE( "long", "range_lengths", t->range_lengths, numStates );
+		indexOffsets = TABLE( "long", "index_offsets", t->index_offsets, numStates );
+		transTargsWI = TABLE( "long", "trans_targs_wi", t->transTargsWI, numTransTargsWI );
+		transActionsWI = TABLE( "long", "trans_actions_wi",
+				t->transActionsWI, numTransActionsWI );
+		toStateActions = TABLE( "long", "to_state_actions", t->to_state_actions, numStates );
+		fromStateActions = TABLE( "long", "from_state_actions",
+				t->from_state_actions, numStates );
+		eofActions = TABLE( "long", "eof_actions", t->eof_actions, numStates );
+		eofTargs = TABLE( "long", "eof_targs", t->eof_targs, numStates );
+
+		actionCode = TABLE( "long", "action_code", t->action_code, numActionCode );
+		actionCodeOffsets = TABLE( "long", "action_code_offsets",
+				t->action_code_offsets, t->num_action_switch );
+		lmSwitchTokens = TABLE( "long", "lm_switch_tokens",
+				t->lm_switch_tokens, numLmSwitchTokens );
+
+		if ( t->flat_indicies != 0 ) {
+			numFlatIndicies = t->num_flat_indicies;
+			numFlatTrans = t->num_flat_trans;
+
+			flatKeys = TABLE( "unsigned char", "flat_keys", t->flat_keys, 2 * numStates );
+			flatKeySpans = TABLE( "long", "flat_key_spans", t->flat_key_spans, numStates );
+			flatIndexOffsets = TABLE( "long", "flat_index_offsets",
+					t->flat_index_offsets, numStates );
+			flatIndicies = TABLE( "long", "flat_indicies", t->flat_indicies, numFlatIndicies );
+			flatTransTargs = TABLE( "long", "flat_trans_targs",
+					t->flat_trans_targs, numFlatTrans );
+			flatTransActions = TABLE( "long", "flat_trans_actions",
+					t->flat_trans_actions, numFlatTrans );
+		}
+
+		loopOffsets = TABLE( "long", "loop_offsets", t->loop_offsets, numStates );
+	}
+
 	out <<
 		"static struct fsm_tables fsmTables_start =\n"
 		"{\n"
-		"	0, "       /* actions */
-		" 0, "         /* keyOffsets */
-		" 0, "         /* transKeys */
-		" 0, "         /* singleLengths */
-		" 0, "         /* rangeLengths */
-		" 0, "         /* indexOffsets */
-		" 0, "         /* transTargsWI */
-		" 0, "         /* transActionsWI */
-		" 0, "         /* toStateActions */
-		" 0, "         /* fromStateActions */
-		" 0, "         /* eofActions */
-		" 0,\n"        /* eofTargs */
+		"	" << actions << ", " << keyOffsets << ", " << transKeys << ", " <<
+				singleLengths << ", " << rangeLengths << ", " << indexOffsets << ",\n"
+		"	" << transTargsWI << ", " << transActionsWI << ", " <<
+				toStateActions << ", " << fromStateActions << ",\n"
+		"	" << eofActions << ", " << eofTargs << ",\n"
 		"	" << ENTRY_BY_REGION() << ",\n"
-
 		"\n"
-		"	0, "       /* numStates */
-		" 0, "         /* numActions */
-		" 0, "         /* numTransKeys */
-		" 0, "         /* numSingleLengths */
-		" 0, "         /* numRangeLengths */
-		" 0, "         /* numIndexOffsets */
-		" 0, "         /* numTransTargsWI */
-		" 0,\n"        /* numTransActionsWI */
+		"	" << numStates << ", "
+		<< numActions << ", "
+		<< numTransKeys << ", "
+		<< numStates << ", "            /* numSingleLengths */
+		<< numStates << ", "            /* numRangeLengths */
+		<< numStates << ", "            /* numIndexOffsets */
+		<< numTransTargsWI << ", "
+		<< numTransActionsWI << ",\n"
 		"	" << redFsm->regionToEntry.length() << ",\n"
 		"\n"
 		"	" << START() << ",\n"
@@ -821,7 +1027,20 @@ void FsmCodeGen::writeData()
 		"	" << ERROR() << ",\n"
 		"\n"
 		"	0,\n"      /* actionSwitch */
-		"	0\n"       /* numActionSwitch */
+		"	0,\n"      /* numActionSwitch */
+		"\n"
+		"	" << actionCode << ", " << actionCodeOffsets << ", " << lmSwitchTokens << ",\n"
+		"	" << numActionCode << ", " << numLmSwitchTokens << ",\n"
+		"\n"
+		"	" << ( redFsm->charClass != 0 ? CHAR_CLASS() : "0" ) << ",\n"
+		"	" << redFsm->numCharClasses << ",\n"
+		"\n"
+		"	" << flatKeys << ", " << flatKeySpans << ", " << flatIndexOffsets << ",\n"
+		"	" << flatIndicies << ", " << flatTransTargs << ", " << flatTransActions << ",\n"
+		"	" << numFlatIndicies << ", " << numFlatTrans << ",\n"
+		"\n"
+		"	" << loopOffsets << ", " << LOOP_RANGES() << ", " <<
+				redFsm->loopRanges.length() << "\n"
 		"};\n"
 		"\n";
 }
@@ -843,13 +1062,64 @@ void FsmCodeGen::writeInit()
 	out << "\n";
 }
 
+/* Function that writes the state visits of an instrumented scanner. The
+ * output is read back with -P. */
+void FsmCodeGen::writeProfile()
+{
+	out <<
+		"static void " << DATA_PREFIX() << "write_profile()\n"
+		"{\n"
+		"	FILE *file = fopen( \"";
+
+	for ( const char *pc = profileWriteFn; *pc != 0; pc++ ) {
+		if ( *pc == '\\' || *pc == '"' )
+			out << '\\';
+		out << *pc;
+	}
+
+	out << "\", \"w\" );\n"
+		"	if ( file != 0 ) {\n"
+		"		int i;\n"
+		"		fprintf( file, \"states %d\\n\", " << redFsm->nextStateId << " );\n"
+		"		for ( i = 0; i < " << redFsm->nextStateId << "; i++ )\n"
+		"			fprintf( file, \"%d %lu\\n\", i, " << STATE_VISITS() << "[i] );\n"
+		"		fclose( file );\n"
+		"	}\n"
+		"}\n"
+		"\n";
+}
+
 void FsmCodeGen::writeExec()
 {
+	if ( tableScanner ) {
+		out <<
+			"static void fsm_execute( struct pda_run *pdaRun, struct input_impl *inputStream )\n"
+			"{\n"
+			"	colm_table_fsm_execute( pdaRun, inputStream );\n"
+			"}\n"
+			"\n";
+		return;
+	}
+
 	setLabelsNeeded();
 
+	if ( profileWriteFn != 0 )
+		writeProfile();
+
 	out <<
 		"static void fsm_execute( struct pda_run *pdaRun, struct input_impl *inputStream )\n"
-		"{\n"
+		"{\n";
+
+	if ( profileWriteFn != 0 ) {
+		out <<
+			"	static int profiling = 0;\n"
+			"	if ( !profiling ) {\n"
+			"		profiling = 1;\n"
+			"		atexit( " << DATA_PREFIX() << "write_profile );\n"
+			"	}\n";
+	}
+
+	out <<
 		"	" << BLOCK_START() << " = pdaRun->p;\n"
 		"/*_resume:*/\n";
 
@@ -890,9 +1160,47 @@ void FsmCodeGen::writeExec()
 		"\n";
 }
 
+/* Load the state visits written by a scanner built with -p. It must come
+ * from the same grammar. */
+bool FsmCodeGen::readProfile( const char *fn )
+{
+	std::ifstream in( fn );
+	if ( !in.is_open() ) {
+		warning() << "could not open scanner profile " << fn << std::endl;
+		return false;
+	}
+
+	string word;
+	long numStates = -1;
+	in >> word >> numStates;
+	if ( !in || word != "states" || numStates != redFsm->nextStateId ) {
+		warning() << "scanner profile " << fn << 
+				" does not match the grammar" << std::endl;
+		return false;
+	}
+
+	RedState **byId = new RedState*[redFsm->nextStateId];
+	memset( byId, 0, sizeof(RedState*) * redFsm->nextStateId );
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		byId[st->id] = st;
+
+	long id;
+	unsigned long visits;
+	while ( in >> id >> visits ) {
+		if ( 0 <= id && id < redFsm->nextStateId && byId[id] != 0 )
+			byId[id]->visits = visits;
+	}
+
+	delete[] byId;
+	return true;
+}
+
 void FsmCodeGen::writeCode()
 {
-	redFsm->depthFirstOrdering();
+	if ( profileReadFn != 0 && readProfile( profileReadFn ) )
+		redFsm->hotStateOrdering();
+	else
+		redFsm->depthFirstOrdering();
 
 	writeData();
 	writeExec();
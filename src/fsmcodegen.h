@@ -119,6 +119,9 @@ protected:
 	string FIRST_FINAL() { return DATA_PREFIX() + "first_final"; }
 
 	string ENTRY_BY_REGION() { return DATA_PREFIX() + "entry_by_region"; }
+	string CHAR_CLASS() { return DATA_PREFIX() + "char_class"; }
+	string LOOP_RANGES() { return DATA_PREFIX() + "loop_ranges"; }
+	string STATE_VISITS() { return DATA_PREFIX() + "state_visits"; }
 
 
 	void INLINE_LIST( ostream &ret, InlineList *inlineList, 
@@ -180,16 +183,22 @@ public:
 	void STATE_CONDS( RedState *state, bool genDefault ); 
 
 	void emitSingleSwitch( RedState *state );
+	RedTrans *emitClassSwitch( RedState *state );
 	void emitRangeBSearch( RedState *state, int level, int low, int high );
 
 	std::ostream &EXIT_STATES();
 	std::ostream &TRANS_GOTO( RedTrans *trans, int level );
+	std::ostream &STATE_TRANS_GOTO( RedState *state, RedTrans *trans, int level );
 	std::ostream &FINISH_CASES();
 
 	void writeIncludes();
 	void writeData();
 	void writeInit();
 	void writeExec();
+	void writeProfile();
+	template <class T> string TABLE( const char *type, string name,
+			const T *vals, long len );
+	bool readProfile( const char *fn );
 	void writeCode();
 	void writeMain( long activeRealm );
 
@@ -68,6 +68,11 @@ extern bool gblLibrary;
 extern long gblActiveRealm;
 extern char machineMain[];
 extern const char *exportHeaderFn;
+extern const char *profileWriteFn;
+extern const char *profileReadFn;
+extern const char *btProfileFn;
+extern bool btMemo;
+extern bool tableScanner;
 
 struct colm_location;
 
@@ -70,11 +70,16 @@ char *colm_filename_add( program_t *prg, const char *fn )
 	return (char*)prg->stream_fns[items];
 }
 
-static struct seq_buf *new_seq_buf()
+static struct seq_buf *new_seq_buf( struct colm_program *prg )
 {
-	struct seq_buf *rb = (struct seq_buf*) malloc( sizeof(struct seq_buf) );
-	memset( rb, 0, sizeof(struct seq_buf) );
-	return rb;
+	prg->seq_buf_stats.allocated += 1;
+	return seq_buf_allocate( prg );
+}
+
+static void free_seq_buf( struct colm_program *prg, struct seq_buf *seq_buf )
+{
+	prg->seq_buf_stats.released += 1;
+	seq_buf_free( prg, seq_buf );
 }
 
 static void input_transfer_loc( struct colm_program *prg, location_t *loc, struct input_impl_seq *ss )
@@ -98,12 +103,17 @@ static void input_stream_stash_head( struct colm_program *prg, struct input_impl
 	debug( prg, REALM_INPUT, "stash_head: stream %p buf %p\n", si, seq_buf );
 	seq_buf->next = si->stash;
 	si->stash = seq_buf;
+
+	si->stash_len += 1;
+	if ( si->stash_len > prg->seq_buf_stats.stash_high_water )
+		prg->seq_buf_stats.stash_high_water = si->stash_len;
 }
 
 static struct seq_buf *input_stream_pop_stash( struct colm_program *prg, struct input_impl_seq *si )
 {
 	struct seq_buf *seq_buf = si->stash;
 	si->stash = si->stash->next;
+	si->stash_len -= 1;
 
 	debug( prg, REALM_INPUT, "pop_stash: stream %p buf %p\n", si, seq_buf );
 
@@ -120,7 +130,7 @@ static void maybe_split( struct colm_program *prg, struct input_impl_seq *iis )
 		if ( split_off != 0 ) {
 			debug( prg, REALM_INPUT, "maybe split: consumed is > 0, splitting\n" );
 
-			struct seq_buf *new_buf = new_seq_buf();
+			struct seq_buf *new_buf = new_seq_buf( prg );
 			new_buf->type = SB_ACCUM;
 			new_buf->si = split_off;
 			new_buf->own_si = 1;
@@ -146,18 +156,21 @@ void init_input_impl_seq( struct input_impl_seq *is, char *name )
 	//is->byte = 0;
 }
 
-static struct seq_buf *input_stream_seq_pop_head( struct input_impl_seq *is )
+static struct seq_buf *input_stream_seq_pop_head( struct colm_program *prg, struct input_impl_seq *is )
 {
+	is->scan_buf = 0;
+
 	struct seq_buf *ret = is->queue.head;
 	is->queue.head = is->queue.head->next;
 	if ( is->queue.head == 0 )
 		is->queue.tail = 0;
 	else
 		is->queue.head->prev = 0;
+	is->queue_len -= 1;
 	return ret;
 }
 
-static void input_stream_seq_append( struct input_impl_seq *is, struct seq_buf *seq_buf )
+static void input_stream_seq_append( struct colm_program *prg, struct input_impl_seq *is, struct seq_buf *seq_buf )
 {
 	if ( is->queue.head == 0 ) {
 		seq_buf->prev = seq_buf->next = 0;
@@ -169,21 +182,30 @@ static void input_stream_seq_append( struct input_impl_seq *is, struct seq_buf *
 		seq_buf->next = 0;
 		is->queue.tail = seq_buf;
 	}
+	is->queue_len += 1;
+	if ( is->queue_len > prg->seq_buf_stats.queue_high_water )
+		prg->seq_buf_stats.queue_high_water = is->queue_len;
 }
 
-static struct seq_buf *input_stream_seq_pop_tail( struct input_impl_seq *is )
+static struct seq_buf *input_stream_seq_pop_tail( struct colm_program *prg, struct input_impl_seq *is )
 {
+	if ( is->scan_buf == is->queue.tail )
+		is->scan_buf = 0;
+
 	struct seq_buf *ret = is->queue.tail;
 	is->queue.tail = is->queue.tail->prev;
 	if ( is->queue.tail == 0 )
 		is->queue.head = 0;
 	else
 		is->queue.tail->next = 0;
+	is->queue_len -= 1;
 	return ret;
 }
 
-static void input_stream_seq_prepend( struct input_impl_seq *is, struct seq_buf *seq_buf )
+static void input_stream_seq_prepend( struct colm_program *prg, struct input_impl_seq *is, struct seq_buf *seq_buf )
 {
+	is->scan_buf = 0;
+
 	if ( is->queue.head == 0 ) {
 		seq_buf->prev = seq_buf->next = 0;
 		is->queue.head = is->queue.tail = seq_buf;
@@ -194,6 +216,9 @@ static void input_stream_seq_prepend( struct input_impl_seq *is, struct seq_buf
 		seq_buf->next = is->queue.head;
 		is->queue.head = seq_buf;
 	}
+	is->queue_len += 1;
+	if ( is->queue_len > prg->seq_buf_stats.queue_high_water )
+		prg->seq_buf_stats.queue_high_water = is->queue_len;
 }
 
 void input_set_eof_mark( struct colm_program *prg, struct input_impl_seq *si, char eof_mark )
@@ -203,6 +228,8 @@ void input_set_eof_mark( struct colm_program *prg, struct input_impl_seq *si, ch
 
 static void input_destructor( program_t *prg, tree_t **sp, struct input_impl_seq *si )
 {
+	colm_add_input_counters( &prg->input_counters, &si->counters );
+
 	struct seq_buf *buf = si->queue.head;
 	while ( buf != 0 ) {
 		if ( is_tree( buf ) )
@@ -212,7 +239,7 @@ static void input_destructor( program_t *prg, tree_t **sp, struct input_impl_seq
 			buf->si->funcs->destructor( prg, sp, buf->si );
 
 		struct seq_buf *next = buf->next;
-		free( buf );
+		free_seq_buf( prg, buf );
 		buf = next;
 	}
 
@@ -222,7 +249,7 @@ static void input_destructor( program_t *prg, tree_t **sp, struct input_impl_seq
 		if ( call_destructor( buf ) )
 			buf->si->funcs->destructor( prg, sp, buf->si );
 
-		free( buf );
+		free_seq_buf( prg, buf );
 		buf = next;
 	}
 
@@ -253,8 +280,17 @@ static int input_get_parse_block( struct colm_program *prg, struct input_impl_se
 	int ret = 0;
 	*copied = 0;
 
-	/* Move over skip bytes. */
+	/* A token that runs over many sources resumes in the source the last
+	 * block came from, skipping what came before it in one step. */
 	struct seq_buf *buf = is->queue.head;
+	long base = 0;
+	if ( is->scan_buf != 0 && *pskip >= is->scan_base ) {
+		buf = is->scan_buf;
+		base = is->scan_base;
+		*pskip -= base;
+	}
+
+	/* Move over skip bytes. */
 	while ( true ) {
 		if ( buf == 0 ) {
 			/* Got through the in-mem buffers without copying anything. */
@@ -264,13 +300,20 @@ static int input_get_parse_block( struct colm_program *prg, struct input_impl_se
 
 		if ( is_stream( buf ) ) {
 			struct stream_impl *si = buf->si;
+			int skip = *pskip;
 			int type = si->funcs->get_parse_block( prg, si, pskip, pdp, copied );
 
 			if ( type == INPUT_EOD || type == INPUT_EOF ) {
+				base += skip - *pskip;
 				buf = buf->next;
 				continue;
 			}
 
+			if ( type == INPUT_DATA ) {
+				is->scan_buf = buf;
+				is->scan_base = base;
+			}
+
 			ret = type;
 			break;
 		}
@@ -322,6 +365,7 @@ static int input_get_parse_block( struct colm_program *prg, struct input_impl_se
 static int input_get_data( struct colm_program *prg, struct input_impl_seq *is, char *dest, int length )
 {
 	int copied = 0;
+	int sources = 0;
 
 	/* Move over skip bytes. */
 	struct seq_buf *buf = is->queue.head;
@@ -343,6 +387,7 @@ static int input_get_data( struct colm_program *prg, struct input_impl_seq *is,
 
 			copied += glen;
 			length -= glen;
+			sources += 1;
 		}
 		else if ( buf->type == SB_TOKEN )
 			break;
@@ -357,6 +402,10 @@ static int input_get_data( struct colm_program *prg, struct input_impl_seq *is,
 		buf = buf->next;
 	}
 
+	is->counters.copied_bytes += copied;
+	if ( sources > 1 )
+		is->counters.crossing_sources += 1;
+
 	return copied;
 }
 
@@ -369,6 +418,7 @@ static int input_consume_data( struct colm_program *prg, struct input_impl_seq *
 	debug( prg, REALM_INPUT, "input_consume_data: stream %p consuming %d bytes\n", si, length );
 
 	int consumed = 0;
+	si->scan_buf = 0;
 
 	/* Move over skip bytes. */
 	while ( true ) {
@@ -398,7 +448,7 @@ static int input_consume_data( struct colm_program *prg, struct input_impl_seq *
 			break;
 		}
 
-		struct seq_buf *seq_buf = input_stream_seq_pop_head( si );
+		struct seq_buf *seq_buf = input_stream_seq_pop_head( prg, si );
 		input_stream_stash_head( prg, si, seq_buf );
 	}
 
@@ -412,6 +462,7 @@ static int input_undo_consume_data( struct colm_program *prg, struct input_impl_
 	debug( prg, REALM_INPUT, "input_undo_consume_data: stream %p undoing consume of %d bytes\n", si, length );
 
 	assert( length > 0 );
+	si->scan_buf = 0;
 	long tot = length;
 	int offset = 0;
 	int remaining = length;
@@ -428,7 +479,7 @@ static int input_undo_consume_data( struct colm_program *prg, struct input_impl_
 		}
 
 		struct seq_buf *b = input_stream_pop_stash( prg, si );
-		input_stream_seq_prepend( si, b );
+		input_stream_seq_prepend( prg, si, b );
 	}
 
 	return tot;
@@ -441,14 +492,14 @@ static tree_t *input_consume_tree( struct colm_program *prg, struct input_impl_s
 	while ( si->queue.head != 0 && is_stream( si->queue.head ) )
 	{
 		debug( prg, REALM_INPUT, "  stream %p consume: clearing source type\n", si );
-		struct seq_buf *seq_buf = input_stream_seq_pop_head( si );
+		struct seq_buf *seq_buf = input_stream_seq_pop_head( prg, si );
 		input_stream_stash_head( prg, si, seq_buf );
 	}
 
 	assert( si->queue.head != 0 && ( si->queue.head->type == SB_TOKEN || si->queue.head->type == SB_IGNORE ) );
 
 	{
-		struct seq_buf *seq_buf = input_stream_seq_pop_head( si );
+		struct seq_buf *seq_buf = input_stream_seq_pop_head( prg, si );
 		input_stream_stash_head( prg, si, seq_buf );
 		tree_t *tree = seq_buf->tree;
 		debug( prg, REALM_INPUT, "  stream %p consume: tree: %p\n", si, tree );
@@ -467,7 +518,7 @@ static void input_undo_consume_tree( struct colm_program *prg, struct input_impl
 		debug( prg, REALM_INPUT, "  stream %p consume: clearing source type\n", si );
 
 		struct seq_buf *b = input_stream_pop_stash( prg, si );
-		input_stream_seq_prepend( si, b );
+		input_stream_seq_prepend( prg, si, b );
 
 		if ( is_tree( b ) ) {
 			assert( b->tree->id == tree->id );
@@ -487,20 +538,20 @@ static void input_prepend_data( struct colm_program *prg, struct input_impl_seq
 
 	struct stream_impl *sub_si = colm_impl_new_text( "<text1>", data, length );
 
-	struct seq_buf *new_buf = new_seq_buf();
+	struct seq_buf *new_buf = new_seq_buf( prg );
 	new_buf->type = SB_ACCUM;
 	new_buf->si = sub_si;
 	new_buf->own_si = 1;
 
-	input_stream_seq_prepend( si, new_buf );
+	input_stream_seq_prepend( prg, si, new_buf );
 }
 
 static int input_undo_prepend_data( struct colm_program *prg, struct input_impl_seq *si, int length )
 {
 	debug( prg, REALM_INPUT, "input_undo_prepend_data: stream %p undo append data length %d\n", si, length );
 
-	struct seq_buf *seq_buf = input_stream_seq_pop_head( si );
-	free( seq_buf );
+	struct seq_buf *seq_buf = input_stream_seq_pop_head( prg, si );
+	free_seq_buf( prg, seq_buf );
 
 	return 0;
 }
@@ -514,10 +565,10 @@ static void input_prepend_tree( struct colm_program *prg, struct input_impl_seq
 	/* Create a new buffer for the data. This is the easy implementation.
 	 * Something better is needed here. It puts a max on the amount of
 	 * data that can be pushed back to the inputStream. */
-	struct seq_buf *new_buf = new_seq_buf();
+	struct seq_buf *new_buf = new_seq_buf( prg );
 	new_buf->type = ignore ? SB_IGNORE : SB_TOKEN;
 	new_buf->tree = tree;
-	input_stream_seq_prepend( si, new_buf );
+	input_stream_seq_prepend( prg, si, new_buf );
 }
 
 static tree_t *input_undo_prepend_tree( struct colm_program *prg, struct input_impl_seq *si )
@@ -527,10 +578,10 @@ static tree_t *input_undo_prepend_tree( struct colm_program *prg, struct input_i
 	assert( si->queue.head != 0 && ( si->queue.head->type == SB_TOKEN ||
 			si->queue.head->type == SB_IGNORE ) );
 
-	struct seq_buf *seq_buf = input_stream_seq_pop_head( si );
+	struct seq_buf *seq_buf = input_stream_seq_pop_head( prg, si );
 
 	tree_t *tree = seq_buf->tree;
-	free(seq_buf);
+	free_seq_buf( prg, seq_buf );
 
 	debug( prg, REALM_INPUT, "  stream %p tree %p\n", si, tree );
 
@@ -545,18 +596,18 @@ static void input_prepend_stream( struct colm_program *prg, struct input_impl_se
 	/* Create a new buffer for the data. This is the easy implementation.
 	 * Something better is needed here. It puts a max on the amount of
 	 * data that can be pushed back to the inputStream. */
-	struct seq_buf *new_buf = new_seq_buf();
+	struct seq_buf *new_buf = new_seq_buf( prg );
 	new_buf->type = SB_SOURCE;
 	new_buf->si = stream_to_impl( stream );
-	input_stream_seq_prepend( si, new_buf );
+	input_stream_seq_prepend( prg, si, new_buf );
 
 	assert( ((struct stream_impl_data*)new_buf->si)->type == 'D' );
 }
 
 static tree_t *input_undo_prepend_stream( struct colm_program *prg, struct input_impl_seq *is )
 {
-	struct seq_buf *seq_buf = input_stream_seq_pop_head( is );
-	free( seq_buf );
+	struct seq_buf *seq_buf = input_stream_seq_pop_head( prg, is );
+	free_seq_buf( prg, seq_buf );
 	return 0;
 }
 
@@ -569,12 +620,12 @@ static void input_append_data( struct colm_program *prg, struct input_impl_seq *
 
 		struct stream_impl *sub_si = colm_impl_new_accum( "<text2>" );
 
-		struct seq_buf *new_buf = new_seq_buf();
+		struct seq_buf *new_buf = new_seq_buf( prg );
 		new_buf->type = SB_ACCUM;
 		new_buf->si = sub_si;
 		new_buf->own_si = 1;
 
-		input_stream_seq_append( si, new_buf );
+		input_stream_seq_append( prg, si, new_buf );
 	}
 
 	si->queue.tail->si->funcs->append_data( prg, si->queue.tail->si, data, length );
@@ -610,8 +661,8 @@ static tree_t *input_undo_append_data( struct colm_program *prg, struct input_im
 			break;
 		}
 
-		struct seq_buf *seq_buf = input_stream_seq_pop_tail( si );
-		free( seq_buf );
+		struct seq_buf *seq_buf = input_stream_seq_pop_tail( prg, si );
+		free_seq_buf( prg, seq_buf );
 	}
 	return 0;
 }
@@ -620,9 +671,9 @@ static void input_append_tree( struct colm_program *prg, struct input_impl_seq *
 {
 	debug( prg, REALM_INPUT, "input_append_tree: stream %p append tree %p\n", si, tree );
 
-	struct seq_buf *ad = new_seq_buf();
+	struct seq_buf *ad = new_seq_buf( prg );
 
-	input_stream_seq_append( si, ad );
+	input_stream_seq_append( prg, si, ad );
 
 	ad->type = SB_TOKEN;
 	ad->tree = tree;
@@ -632,9 +683,9 @@ static tree_t *input_undo_append_tree( struct colm_program *prg, struct input_im
 {
 	debug( prg, REALM_INPUT, "input_undo_append_tree: stream %p undo append tree\n", si );
 
-	struct seq_buf *seq_buf = input_stream_seq_pop_tail( si );
+	struct seq_buf *seq_buf = input_stream_seq_pop_tail( prg, si );
 	tree_t *tree = seq_buf->tree;
-	free( seq_buf );
+	free_seq_buf( prg, seq_buf );
 	return tree;
 }
 
@@ -642,9 +693,9 @@ static void input_append_stream( struct colm_program *prg, struct input_impl_seq
 {
 	debug( prg, REALM_INPUT, "input_append_stream: stream %p append stream %p\n", si, stream );
 
-	struct seq_buf *ad = new_seq_buf();
+	struct seq_buf *ad = new_seq_buf( prg );
 
-	input_stream_seq_append( si, ad );
+	input_stream_seq_append( prg, si, ad );
 
 	ad->type = SB_SOURCE;
 	ad->si = stream_to_impl( stream );
@@ -656,11 +707,43 @@ static tree_t *input_undo_append_stream( struct colm_program *prg, struct input_
 {
 	debug( prg, REALM_INPUT, "input_undo_append_stream: stream %p undo append stream\n", si );
 
-	struct seq_buf *seq_buf = input_stream_seq_pop_tail( si );
-	free( seq_buf );
+	struct seq_buf *seq_buf = input_stream_seq_pop_tail( prg, si );
+	free_seq_buf( prg, seq_buf );
 	return 0;
 }
 
+/* Stable pointer to the next length bytes, if the stream at the head of the
+ * queue can give one. Otherwise the data has to be copied out. */
+static const char *input_get_data_ptr( struct colm_program *prg, struct input_impl_seq *is, int length, struct run_buf **prb )
+{
+	/* A source the last token finished off stays at the head until the next
+	 * consume. Look past those to the source the token starts in. */
+	struct seq_buf *buf = is->queue.head;
+	while ( buf != 0 && is_stream( buf ) && buf->si->funcs->get_data_ptr != 0 ) {
+		const char *ptr = buf->si->funcs->get_data_ptr( prg, buf->si, length, prb );
+		if ( ptr != 0 )
+			return ptr;
+
+		int skip = 0, copied;
+		char *pd;
+		int type = buf->si->funcs->get_parse_block( prg, buf->si, &skip, &pd, &copied );
+		if ( type != INPUT_EOD && type != INPUT_EOF )
+			break;
+
+		buf = buf->next;
+	}
+	return 0;
+}
+
+/* The source the last token came from is still at the head. Sources before
+ * it keep what they have, which is safe. */
+static void input_commit_consumed( struct colm_program *prg, struct input_impl_seq *is, long keep )
+{
+	struct seq_buf *buf = is->queue.head;
+	if ( buf != 0 && is_stream( buf ) )
+		buf->si->funcs->commit_consumed( prg, buf->si, keep );
+}
+
 struct input_funcs_seq input_funcs = 
 {
 	&input_get_parse_block,
@@ -705,6 +788,9 @@ struct input_funcs_seq input_funcs =
 	/* Trimming */
 	&input_get_option,
 	&input_set_option,
+
+	&input_get_data_ptr,
+	&input_commit_consumed,
 };
 
 struct input_impl *colm_impl_new_generic( char *name )
@@ -31,8 +31,14 @@ extern "C" {
 #endif
 
 #define FSM_BUFSIZE 8192
+#define FSM_BUFSIZE_MAX 0x100000
 //#define FSM_BUFSIZE 8
 
+/* Options for get_option and set_option. */
+#define STREAM_OPT_AUTO_TRIM   0
+#define STREAM_OPT_BLOCK_SIZE  1
+#define STREAM_OPT_READ_AHEAD  2
+
 #define INPUT_DATA     1
 /* This is for data sources to return, not for the wrapper. */
 #define INPUT_EOD      2
@@ -48,11 +54,13 @@ struct colm_stream;
 struct colm_location;
 struct colm_program;
 struct colm_struct;
+struct run_buf;
 struct colm_str;
 struct colm_stream;
 
 struct input_impl;
 struct stream_impl;
+struct read_ahead;
 
 #define DEF_INPUT_FUNCS( input_funcs, _input_impl ) \
 struct input_funcs \
@@ -82,6 +90,8 @@ struct input_funcs \
 	void (*destructor)( struct colm_program *prg, struct colm_tree **sp, struct _input_impl *si ); \
 	int (*get_option)( struct colm_program *prg, struct _input_impl *si, int option ); \
 	void (*set_option)( struct colm_program *prg, struct _input_impl *si, int option, int value ); \
+	const char *(*get_data_ptr)( struct colm_program *prg, struct _input_impl *si, int length, struct run_buf **prb ); \
+	void (*commit_consumed)( struct colm_program *prg, struct _input_impl *si, long keep ); \
 }
 
 #define DEF_STREAM_FUNCS( stream_funcs, _stream_impl ) \
@@ -104,6 +114,8 @@ struct stream_funcs \
 	void (*destructor)( struct colm_program *prg, struct colm_tree **sp, struct _stream_impl *si ); \
 	int (*get_option)( struct colm_program *prg, struct _stream_impl *si, int option ); \
 	void (*set_option)( struct colm_program *prg, struct _stream_impl *si, int option, int value ); \
+	const char *(*get_data_ptr)( struct colm_program *prg, struct _stream_impl *si, int length, struct run_buf **prb ); \
+	void (*commit_consumed)( struct colm_program *prg, struct _stream_impl *si, long keep ); \
 }
 
 DEF_INPUT_FUNCS( input_funcs, input_impl );
@@ -153,6 +165,18 @@ struct input_impl_seq
 
 	struct seq_buf *stash;
 
+	/* Where the last parse block came from, as in the data streams. Reset
+	 * when sources are consumed or undone. */
+	struct seq_buf *scan_buf;
+	long scan_base;
+
+	/* Data copied out and tokens that came from more than one source. */
+	struct colm_input_counters counters;
+
+	/* Current lengths of the queue and stash, for the high water marks. */
+	int queue_len;
+	int stash_len;
+
 	int consumed;
 	int auto_trim;
 };
@@ -163,12 +187,86 @@ struct run_buf
 	long offset;
 	struct run_buf *next, *prev;
 
+	/* Space in data, FSM_BUFSIZE or more. */
+	long size;
+
+	/* Tokens pointing into data. A buffer that leaves its stream while
+	 * referenced is retired to the program and freed by the last token. */
+	long refs;
+	int retired;
+
+	/* Set on the buffer that stands for a mapped file. It holds no data, but
+	 * tokens pin it to keep the mapping alive. Freeing it unmaps the file. */
+	struct file_mapping *file_mapping;
+
 	/* Must be at the end. We will grow this struct to add data if the input
 	 * demands it. */
 	char data[FSM_BUFSIZE];
 };
 
-struct run_buf *new_run_buf( int sz );
+/* Sequence buffers come from a per-program pool. These count what the input
+ * sequences of a program ask of it. */
+struct seq_buf_stats
+{
+	long allocated;
+	long released;
+	long queue_high_water;
+	long stash_high_water;
+};
+
+/* Free run_bufs kept for reuse, one list per power of two size from
+ * FSM_BUFSIZE to FSM_BUFSIZE_MAX. At most RUN_BUF_POOL_MAX bytes are kept. */
+#define RUN_BUF_CLASSES 8
+#define RUN_BUF_POOL_MAX ( 4 * FSM_BUFSIZE_MAX )
+
+struct run_buf_pool
+{
+	struct run_buf *free[RUN_BUF_CLASSES];
+
+	long allocated;
+	long reused;
+	long released;
+	long pooled;
+	long high_water;
+	long pinned;
+};
+
+struct run_buf *new_run_buf( struct colm_program *prg, int sz );
+void free_run_buf( struct colm_program *prg, struct run_buf *rb );
+void colm_run_buf_pool_clear( struct colm_program *prg );
+void colm_run_buf_unpin( struct colm_program *prg, struct run_buf *rb );
+
+#define LINE_INDEX_CHUNK 4096
+
+/* Byte offsets of the newlines consumed from a stream, kept in fixed size
+ * chunks so growing never copies. Used when locations are resolved lazily.
+ * Owned by the program, since locations outlive the streams they came from.
+ * Entries from length up to filled belong to text that was sent back. They are
+ * kept while consumed text agrees with them, so locations taken before the
+ * undo still resolve. */
+struct line_index
+{
+	long **chunks;
+	long num_chunks;
+	long length;
+	long filled;
+	struct line_index *next;
+};
+
+void colm_line_index_delete( struct line_index *li );
+
+/* Largest block handed to the scanner from a file mapping. */
+#define MMAP_BLOCK 0x40000000
+
+/* A read-only file mapping. */
+struct file_mapping
+{
+	char *data;
+	long length;
+};
+
+void colm_file_mapping_delete( struct file_mapping *fm );
+void colm_location_resolve( struct colm_location *loc );
 
 struct stream_impl_data
 {
@@ -184,6 +282,9 @@ struct stream_impl_data
 	long dlen;
 	int offset;
 
+	/* For mapped files, the buffer that pins the mapping data points into. */
+	struct run_buf *mapping;
+
 	long line;
 	long column;
 	long byte;
@@ -197,15 +298,50 @@ struct stream_impl_data
 
 	struct indent_impl indent;
 
+	/* Lengths of the lines consumed, for restoring the column when text is
+	 * sent back. Grows until a commit says how much can still come back and
+	 * the older lines are dropped. */
 	int *line_len;
 	int lines_alloc;
-	int lines_cur;
+	int lines_avail;
+
+	struct line_index *line_index;
 
 	int auto_trim;
+
+	/* Size of reads from the source. Zero block_size lets read_size adapt,
+	 * which it does only for sources that fill every read they can, strings
+	 * and regular files. */
+	int block_size;
+	int read_size;
+	int grow_reads;
+
+	struct read_ahead *read_ahead;
+
+	/* Reads, buffers and undo of this stream. */
+	struct colm_input_counters counters;
+
+	/* Where the last parse block came from. A scanner continuing a token
+	 * asks to skip what it has seen, which is at least scan_base, the data
+	 * ahead of scan_buf. Reset when the queue changes at the head. */
+	struct run_buf *scan_buf;
+	long scan_base;
+
+	/* Printed output not yet written to the file. Terminals and stderr are
+	 * not buffered, which is decided on the first write. */
+	char *out_buf;
+	int out_len;
+	int out_direct;
 };
 
+/* Output buffer of file streams. Fragments of at least OUT_DIRECT bytes are
+ * not copied but written along with the buffer. */
+#define OUT_BUF_SIZE 65536
+#define OUT_DIRECT 4096
+
 void stream_impl_push_line( struct stream_impl_data *ss, int ll );
 int stream_impl_pop_line( struct stream_impl_data *ss );
+void stream_impl_write( struct stream_impl_data *ss, const char *data, int length );
 
 struct input_impl *colm_impl_new_generic( char *name );
 
@@ -214,6 +350,9 @@ void undo_position( struct stream_impl *input_stream, const char *data, long len
 
 struct stream_impl *colm_stream_impl( struct colm_struct *s );
 
+void colm_add_input_counters( struct colm_input_counters *dest,
+		const struct colm_input_counters *src );
+
 struct colm_str *collect_string( struct colm_program *prg, struct colm_stream *s );
 struct colm_stream *colm_stream_open_collect( struct colm_program *prg );
 
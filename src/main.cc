@@ -77,6 +77,11 @@ const char *binaryFn = 0;
 const char *exportHeaderFn = 0;
 const char *exportCodeFn = 0;
 const char *commitCodeFn = 0;
+const char *profileWriteFn = 0;
+const char *profileReadFn = 0;
+const char *btProfileFn = 0;
+bool btMemo = false;
+bool tableScanner = false;
 const char *objectName = "colm_object";
 bool exportCode = false;
 bool hostAdapters = true;
@@ -188,7 +193,15 @@ void usage()
 "   -L <path>            additional library path for the linker\n"
 "   -l                   activate logging\n"
 "   -c                   compile only (don't produce binary)\n"
+"   -p <file>            instrument the scanner to write a state profile\n"
+"                        to <file> at exit\n"
+"   -P <file>            lay out scanner states using the profile in <file>\n"
+"   -T                   generate a table driven scanner\n"
+"   -B <file>            write a profile of parser backtracking to <file>\n"
+"                        at exit\n"
+"   -F                   skip parser alternatives already seen to fail\n"
 "   -V                   print dot format (graphiz)\n"
+"   -s                   print parser table statistics\n"
 "   -d                   print verbose debug information\n"
 #if DEBUG
 "   -D <tag>             print more information about <tag>\n"
@@ -485,6 +498,10 @@ void compileOutput( const char *argv0, const bool inSource, char *srcLocation )
 		strcat( command, *lp );
 	}
 	strcat( command, " -lcolm" );
+#if defined(HAVE_PTHREAD_H)
+	/* The runtime's read-ahead thread. */
+	strcat( command, " -lpthread" );
+#endif
 
 	compileOutputCommand( command );
 
@@ -530,7 +547,7 @@ bool inSourceTree( const char *argv0, char *&location )
 
 void processArgs( int argc, const char **argv )
 {
-	ParamCheck pc( "cD:e:x:I:L:vdlio:S:M:vHh?-:sVa:m:b:E:", argc, argv );
+	ParamCheck pc( "cD:e:x:I:L:vdlio:S:M:vHh?-:sVa:m:b:E:p:P:TB:F", argc, argv );
 
 	while ( pc.check() ) {
 		switch ( pc.state ) {
@@ -616,6 +633,21 @@ void processArgs( int argc, const char **argv )
 			case 'm':
 				commitCodeFn = pc.parameterArg;
 				break;
+			case 'p':
+				profileWriteFn = pc.parameterArg;
+				break;
+			case 'P':
+				profileReadFn = pc.parameterArg;
+				break;
+			case 'T':
+				tableScanner = true;
+				break;
+			case 'B':
+				btProfileFn = pc.parameterArg;
+				break;
+			case 'F':
+				btMemo = true;
+				break;
 
 			case 'E': {
 				const char *eq = strchr( pc.parameterArg, '=' );
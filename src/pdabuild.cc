@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -863,6 +864,34 @@ void Compiler::reduceActions( PdaGraph *pdaGraph )
 	}
 }
 
+/* Find the states that reduce the same production on every token they accept.
+ * The parser can reduce in these without consulting the token. A token that
+ * is not accepted is then caught in the state the reduction goes to. This is
+ * only safe when nothing happens that backtracking cannot take back, so the
+ * reduction must have no reduction code and there can be no commit. */
+void Compiler::defaultReductions( PdaGraph *pdaGraph )
+{
+	for ( PdaStateList::Iter state = pdaGraph->stateList; state.lte(); state++ ) {
+		if ( state->transMap.length() == 0 )
+			continue;
+
+		bool single = true;
+		PdaActionSetEl *actionSetEl = state->transMap[0].value->actionSetEl;
+		for ( TransMap::Iter trans = state->transMap; trans.lte(); trans++ ) {
+			if ( trans->value->actionSetEl != actionSetEl )
+				single = false;
+		}
+
+		if ( single && actionSetEl->key.actions.length() == 1 &&
+				( actionSetEl->key.actions[0] & 0x3 ) == REDUCE_CODE &&
+				actionSetEl->key.commitLen == 0 &&
+				prodIdIndex[actionSetEl->key.actions[0] >> 2]->redBlock == 0 )
+		{
+			state->defaultReduce = actionSetEl;
+		}
+	}
+}
+
 void Compiler::computeAdvanceReductions( LangEl *langEl, PdaGraph *pdaGraph )
 {
 	/* Get the entry into the graph and traverse over the root. The resulting
@@ -1022,6 +1051,7 @@ void Compiler::analyzeMachine( PdaGraph *pdaGraph, LangElSet &parserEls )
 	advanceReductions( pdaGraph );
 	pdaGraph->setStateNumbers();
 	reduceActions( pdaGraph );
+	defaultReductions( pdaGraph );
 
 	/* Set the action ids. */
 	int actionSetId = 0;
@@ -1703,7 +1733,7 @@ void Compiler::makeRuntimeData()
 	runtimeData->struct_stream_id = structStreamId;
 	runtimeData->struct_input_id = structInputId;
 
-	runtimeData->fsm_execute = &internalFsmExecute;
+	runtimeData->fsm_execute = &colm_table_fsm_execute;
 	runtimeData->send_named_lang_el = &internalSendNamedLangEl;
 	runtimeData->init_bindings = &internalInitBindings;
 	runtimeData->pop_binding = &internalPopBinding;
@@ -1971,6 +2001,19 @@ struct CmpSpan
 	}
 };
 
+/* Most transitions first. Ties go to the wider span. */
+struct CmpTransCount
+{
+	static int compare( PdaState *state1, PdaState *state2 )
+	{
+		if ( state1->transMap.length() < state2->transMap.length() )
+			return 1;
+		else if ( state2->transMap.length() < state1->transMap.length() )
+			return -1;
+		return CmpSpan::compare( state1, state2 );
+	}
+};
+
 PdaGraph *Compiler::makePdaGraph( LangElSet &parserEls )
 {
 	//for ( DefList::Iter prod = prodList; prod.lte(); prod++ )
@@ -2026,10 +2069,10 @@ struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 	for ( PdaStateList::Iter state = pdaGraph->stateList; state.lte(); state++ )
 		states[ds++] = state;
 
-	/* Sorting baseded on span length. Gives an improvement, but incures a
-	 * cost. Off for now. */
-	//MergeSort< PdaState*, CmpSpan > mergeSort;
-	//mergeSort.sort( states, numStates );
+	/* Place the states with the most transitions first, while there is the
+	 * most room, and fit the sparse ones into the gaps they leave. */
+	MergeSort< PdaState*, CmpTransCount > mergeSort;
+	mergeSort.sort( states, numStates );
 	
 	int indLen = 0;
 	for ( int s = 0; s < numStates; s++ ) {
@@ -2133,6 +2176,15 @@ struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 	for ( PdaActionSet::Iter asi = pdaGraph->actionSet; asi.lte(); asi++ )
 		pdaTables->commit_len[count++] = asi->key.commitLen;
 	
+	/*
+	 * DefaultInds
+	 */
+	pdaTables->default_inds = new int[pdaTables->num_states];
+	for ( PdaStateList::Iter state = pdaGraph->stateList; state.lte(); state++ ) {
+		pdaTables->default_inds[state->stateNum] = state->defaultReduce != 0 ?
+				state->defaultReduce->key.id : -1;
+	}
+
 	/*
 	 * tokenRegionInds. Start at one so region index 0 is null (unset).
 	 */
@@ -2192,10 +2244,115 @@ struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 		pdaTables->token_pre_regions[count++] = 0;
 	}
 
+	if ( printStatistics )
+		printTableStats( pdaGraph, pdaTables );
 
 	return pdaTables;
 }
 
+static double monotonicNs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define LOOKUP_ROUNDS 2000000
+
+static volatile unsigned int lookupSink;
+
+/* Average time of a parser table lookup, in nanoseconds, going round the
+ * given state and lang el pairs. Which pair comes next depends on the result
+ * of the last lookup, so lookups cannot overlap and this is their latency. A
+ * default reduction is looked up as parse_token does, without the keys,
+ * owners and indicies checks. */
+static double lookupLatency( struct pda_tables *pdaTables,
+		int *states, int *ids, long n, bool defaultReduce )
+{
+	if ( n == 0 )
+		return 0;
+
+	unsigned int sum = 0;
+	long i = 0;
+	double start = monotonicNs();
+	for ( long r = 0; r < LOOKUP_ROUNDS; r++ ) {
+		int state = states[i], id = ids[i];
+		int pos;
+		if ( defaultReduce )
+			pos = pdaTables->default_inds[state];
+		else {
+			int indPos = pdaTables->offsets[state] + ( id - pdaTables->keys[state<<1] );
+			pos = pdaTables->owners[indPos] == state ? pdaTables->indicies[indPos] : -1;
+		}
+
+		unsigned int action = pdaTables->actions[pdaTables->act_inds[pos]];
+		sum += action + pdaTables->targs[pos];
+
+		i += 1 + ( action & 1 );
+		if ( i >= n )
+			i -= n;
+	}
+	double ns = ( monotonicNs() - start ) / LOOKUP_ROUNDS;
+
+	/* Keep the loop from being optimized out. */
+	lookupSink = sum;
+
+	return ns;
+}
+
+void Compiler::printTableStats( PdaGraph *pdaGraph, struct pda_tables *pdaTables )
+{
+	long numTrans = 0, numDefault = 0;
+	for ( PdaStateList::Iter state = pdaGraph->stateList; state.lte(); state++ ) {
+		numTrans += state->transMap.length();
+		if ( state->defaultReduce != 0 )
+			numDefault += 1;
+	}
+
+	/* Indicies and owners, keys, per-state and per-action-set arrays. */
+	long size = sizeof(int) * (
+		2 * pdaTables->num_indicies +
+		pdaTables->num_keys +
+		3 * pdaTables->num_states +
+		3 * pdaTables->num_targs +
+		pdaTables->num_actions +
+		pdaTables->num_region_items +
+		pdaTables->num_pre_region_items );
+
+	cerr << "parser states: " << pdaTables->num_states << endl;
+	cerr << "default reduce states: " << numDefault << endl;
+	cerr << "transitions: " << numTrans << endl;
+	cerr << "indicies: " << pdaTables->num_indicies << endl;
+	cerr << "action sets: " << pdaTables->num_targs << endl;
+	cerr << "table bytes: " << size << endl;
+
+	/* Every transition, and the terminals of default reduce states. */
+	int *states = new int[numTrans], *ids = new int[numTrans];
+	int *defStates = new int[numTrans], *defIds = new int[numTrans];
+	long n = 0, numDef = 0;
+	for ( PdaStateList::Iter state = pdaGraph->stateList; state.lte(); state++ ) {
+		for ( TransMap::Iter trans = state->transMap; trans.lte(); trans++ ) {
+			states[n] = state->stateNum;
+			ids[n] = trans->key;
+			n += 1;
+			if ( state->defaultReduce != 0 && trans->key < firstNonTermId ) {
+				defStates[numDef] = state->stateNum;
+				defIds[numDef] = trans->key;
+				numDef += 1;
+			}
+		}
+	}
+
+	cerr << "lookup ns: " << lookupLatency( pdaTables, states, ids, n, false ) << endl;
+	cerr << "default reduce lookup ns: " <<
+			lookupLatency( pdaTables, defStates, defIds, numDef, true ) << endl;
+
+	delete[] states;
+	delete[] ids;
+	delete[] defStates;
+	delete[] defIds;
+}
+
 void Compiler::makeParser( LangElSet &parserEls )
 {
 	pdaGraph = makePdaGraph( parserEls );
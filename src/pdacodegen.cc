@@ -631,6 +631,18 @@ void PdaCodeGen::writeParserData( long id, struct pda_tables *tables )
 	}
 	out << "\n};\n\n";
 
+	out << "static int " << prefix << defaultInds() << "[] = {\n\t";
+	for ( int i = 0; i < tables->num_states; i++ ) {
+		out << tables->default_inds[i];
+
+		if ( i < tables->num_states-1 ) {
+			out << ", ";
+			if ( (i+1) % 8 == 0 )
+				out << "\n\t";
+		}
+	}
+	out << "\n};\n\n";
+
 	out << "static int " << prefix << tokenRegionInds() << "[] = {\n\t";
 	for ( int i = 0; i < tables->num_states; i++ ) {
 		out << tables->token_region_inds[i];
@@ -678,6 +690,7 @@ void PdaCodeGen::writeParserData( long id, struct pda_tables *tables )
 		"	" << prefix << actInds() << ",\n"
 		"	" << prefix << actions() << ",\n"
 		"	" << prefix << commitLen() << ",\n"
+		"	" << prefix << defaultInds() << ",\n"
 
 		"	" << prefix << tokenRegionInds() << ",\n"
 		"	" << prefix << tokenRegions() << ",\n"
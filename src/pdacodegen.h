@@ -59,6 +59,7 @@ struct PdaCodeGen
 	String actInds() { return PARSER() + "actInds"; }
 	String actions() { return PARSER() + "actions"; }
 	String commitLen() { return PARSER() + "commitLen"; }
+	String defaultInds() { return PARSER() + "defaultInds"; }
 	String fssProdIdIndex() { return PARSER() + "fssProdIdIndex"; }
 	String prodLengths() { return PARSER() + "prodLengths"; }
 	String prodLhsIds() { return PARSER() + "prodLhsIds"; }
@@ -96,7 +97,6 @@ struct PdaCodeGen
 
 extern "C"
 {
-	void internalFsmExecute( struct pda_run *pdaRun, struct input_impl *inputStream );
 	void internalSendNamedLangEl( program_t *prg, tree_t **sp,
 			struct pda_run *pdaRun, struct input_impl *is );
 	void internalInitBindings( struct pda_run *pdaRun );
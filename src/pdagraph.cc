@@ -52,7 +52,8 @@ PdaState::PdaState()
 	inClosedMap(false),
 	followMarked(false),
 
-	advanceReductions(false)
+	advanceReductions(false),
+	defaultReduce(0)
 {
 }
 
@@ -79,7 +80,8 @@ PdaState::PdaState(const PdaState &other)
 	inClosedMap(false),
 	followMarked(false),
 
-	transMap()
+	transMap(),
+	defaultReduce(0)
 {
 	/* Duplicate all the transitions. */
 	for ( TransMap::Iter trans = other.transMap; trans.lte(); trans++ ) {
@@ -378,6 +378,9 @@ struct PdaState
 	RegionVect preRegions;
 
 	bool advanceReductions;
+
+	/* The one reduction the state makes, whatever the token. */
+	PdaActionSetEl *defaultReduce;
 };
 
 /* Compare lists of epsilon transitions. Entries are name ids of targets. */
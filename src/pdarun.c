@@ -36,6 +36,10 @@
 #include "pool.h"
 #include "internal.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define act_sb 0x1
 #define act_rb 0x2
 
@@ -101,13 +105,211 @@ void colm_decrement_steps( struct pda_run *pda_run )
 	//debug( prg, REALM_PARSE, "steps down to %ld\n", pdaRun->steps );
 }
 
+struct bt_profile *colm_bt_profile_new( program_t *prg, const char *file )
+{
+	struct bt_profile *prof = (struct bt_profile*) malloc( sizeof(struct bt_profile) );
+	memset( prof, 0, sizeof(struct bt_profile) );
+
+	prof->file = file != 0 ? strdup( file ) : 0;
+
+	prof->num_states = prg->rtd->pda_tables->num_states;
+	prof->states = (struct bt_state_prof*) calloc( prof->num_states,
+			sizeof(struct bt_state_prof) );
+
+	long s;
+	for ( s = 0; s < prof->num_states; s++ )
+		prof->states[s].lel_id = -1;
+
+	prof->num_prods = prg->rtd->num_prods;
+	prof->prods = (struct bt_prod_prof*) calloc( prof->num_prods,
+			sizeof(struct bt_prod_prof) );
+
+	/* Trees record the lhs and the production number. Count the productions
+	 * of each lhs to find where its run of indexes starts. */
+	long num_lels = prg->rtd->num_lang_els;
+	prof->lel_prods = (long*) calloc( num_lels + 1, sizeof(long) );
+
+	long p;
+	for ( p = 0; p < prof->num_prods; p++ ) {
+		struct prod_info *pi = &prg->rtd->prod_info[p];
+		if ( prof->lel_prods[pi->lhs_id + 1] < pi->prod_num + 1 )
+			prof->lel_prods[pi->lhs_id + 1] = pi->prod_num + 1;
+	}
+
+	long l;
+	for ( l = 1; l <= num_lels; l++ )
+		prof->lel_prods[l] += prof->lel_prods[l - 1];
+
+	prof->prod_index = (long*) malloc( sizeof(long) * ( prof->lel_prods[num_lels] + 1 ) );
+	for ( p = 0; p < prof->num_prods; p++ ) {
+		struct prod_info *pi = &prg->rtd->prod_info[p];
+		prof->prod_index[prof->lel_prods[pi->lhs_id] + pi->prod_num] = p;
+	}
+
+	prof->error_state = -1;
+	prof->rcode_prod = -1;
+
+	return prof;
+}
+
+void colm_bt_profile_free( struct bt_profile *prof )
+{
+	free( prof->file );
+	free( prof->states );
+	free( prof->prods );
+	free( prof->lel_prods );
+	free( prof->prod_index );
+	free( prof );
+}
+
+static long bt_profile_prod( struct bt_profile *prof, parse_tree_t *parse_tree )
+{
+	return prof->prod_index[prof->lel_prods[parse_tree->id] +
+			parse_tree->shadow->tree->prod_num];
+}
+
+/* A parse error starts the undoing. */
+static void bt_profile_error( struct bt_profile *prof, long state )
+{
+	if ( state >= 0 )
+		prof->states[state].errors += 1;
+
+	prof->error_state = state;
+	prof->sent_back = 0;
+	prof->rescan_bytes = 0;
+	prof->rcode_bytes = 0;
+}
+
+/* Charge the undoing to the state that takes up the next alternative, or the
+ * state of the error when the parse stops or fails. */
+static void bt_profile_charge( struct bt_profile *prof, long state, int retry, long lel_id )
+{
+	if ( state >= 0 ) {
+		struct bt_state_prof *st = &prof->states[state];
+		if ( retry ) {
+			st->retries += 1;
+			if ( lel_id >= 0 )
+				st->lel_id = lel_id;
+		}
+		st->sent_back += prof->sent_back;
+		st->rescan_bytes += prof->rescan_bytes;
+		st->rcode_bytes += prof->rcode_bytes;
+	}
+
+	prof->error_state = -1;
+	prof->sent_back = 0;
+	prof->rescan_bytes = 0;
+	prof->rcode_bytes = 0;
+}
+
+static void bt_profile_send_back( struct bt_profile *prof, parse_tree_t *parse_tree )
+{
+	head_t *head = parse_tree->shadow->tree->tokdata;
+
+	prof->sent_back += 1;
+	if ( head != 0 && !( parse_tree->flags & PF_ARTIFICIAL ) )
+		prof->rescan_bytes += head->length;
+
+	/* Reverse code of tokens goes to no production. */
+	if ( parse_tree->flags & PF_HAS_RCODE )
+		prof->rcode_prod = -1;
+}
+
+static unsigned long bt_state_work( struct bt_state_prof *st )
+{
+	return st->rescan_bytes + st->rcode_bytes;
+}
+
+static int bt_state_cmp( const void *v1, const void *v2 )
+{
+	struct bt_state_prof *s1 = *(struct bt_state_prof**)v1;
+	struct bt_state_prof *s2 = *(struct bt_state_prof**)v2;
+
+	if ( bt_state_work( s1 ) != bt_state_work( s2 ) )
+		return bt_state_work( s1 ) < bt_state_work( s2 ) ? 1 : -1;
+	if ( s1->retries != s2->retries )
+		return s1->retries < s2->retries ? 1 : -1;
+	if ( s1->errors != s2->errors )
+		return s1->errors < s2->errors ? 1 : -1;
+	return s1 < s2 ? -1 : ( s1 > s2 ? 1 : 0 );
+}
+
+static int bt_prod_cmp( const void *v1, const void *v2 )
+{
+	struct bt_prod_prof *p1 = *(struct bt_prod_prof**)v1;
+	struct bt_prod_prof *p2 = *(struct bt_prod_prof**)v2;
+
+	if ( p1->undone != p2->undone )
+		return p1->undone < p2->undone ? 1 : -1;
+	if ( p1->rcode_bytes != p2->rcode_bytes )
+		return p1->rcode_bytes < p2->rcode_bytes ? 1 : -1;
+	return p1 < p2 ? -1 : ( p1 > p2 ? 1 : 0 );
+}
+
+/* Write the states and productions that did any backtracking, the most work
+ * first. Work is the bytes that had to be scanned again plus the reverse code
+ * that was run. */
+void colm_bt_profile_write( program_t *prg, struct bt_profile *prof )
+{
+	FILE *file = stderr;
+	if ( prof->file != 0 ) {
+		file = fopen( prof->file, "w" );
+		if ( file == 0 )
+			return;
+	}
+
+	struct bt_state_prof **states = (struct bt_state_prof**)
+			malloc( sizeof(struct bt_state_prof*) * ( prof->num_states + 1 ) );
+	long s, ns = 0;
+	for ( s = 0; s < prof->num_states; s++ ) {
+		struct bt_state_prof *st = &prof->states[s];
+		if ( st->errors != 0 || st->retries != 0 || st->sent_back != 0 || st->rcode_bytes != 0 )
+			states[ns++] = st;
+	}
+	qsort( states, ns, sizeof(struct bt_state_prof*), bt_state_cmp );
+
+	fprintf( file, "%8s %10s %10s %10s %12s %12s  %s\n", "state", "errors",
+			"retries", "sent back", "rescanned", "rcode bytes", "retried on" );
+	for ( s = 0; s < ns; s++ ) {
+		struct bt_state_prof *st = states[s];
+		fprintf( file, "%8ld %10lu %10lu %10lu %12lu %12lu  %s\n",
+				(long)(st - prof->states), st->errors, st->retries,
+				st->sent_back, st->rescan_bytes, st->rcode_bytes,
+				st->lel_id >= 0 ? prg->rtd->lel_info[st->lel_id].name : "-" );
+	}
+	free( states );
+
+	struct bt_prod_prof **prods = (struct bt_prod_prof**)
+			malloc( sizeof(struct bt_prod_prof*) * ( prof->num_prods + 1 ) );
+	long p, np = 0;
+	for ( p = 0; p < prof->num_prods; p++ ) {
+		struct bt_prod_prof *pp = &prof->prods[p];
+		if ( pp->undone != 0 || pp->rcode_bytes != 0 )
+			prods[np++] = pp;
+	}
+	qsort( prods, np, sizeof(struct bt_prod_prof*), bt_prod_cmp );
+
+	fprintf( file, "\n%10s %12s  %s\n", "undone", "rcode bytes", "production" );
+	for ( p = 0; p < np; p++ ) {
+		struct bt_prod_prof *pp = prods[p];
+		fprintf( file, "%10lu %12lu  %s\n", pp->undone, pp->rcode_bytes,
+				prg->rtd->prod_info[pp - prof->prods].name );
+	}
+	free( prods );
+
+	if ( file != stderr )
+		fclose( file );
+}
+
 head_t *colm_stream_pull( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 		struct input_impl *is, long length )
 {
+	prg->input_changes += 1;
+
 	if ( pda_run != 0 ) {
 		struct run_buf *run_buf = pda_run->consume_buf;
-		if ( length > ( FSM_BUFSIZE - run_buf->length ) ) {
-			run_buf = new_run_buf( 0 );
+		if ( length > ( run_buf->size - run_buf->length ) ) {
+			run_buf = new_run_buf( prg, length );
 			run_buf->next = pda_run->consume_buf;
 			pda_run->consume_buf = run_buf;
 		}
@@ -143,21 +345,26 @@ head_t *colm_stream_pull( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 
 void colm_stream_push_text( struct colm_program *prg, struct input_impl *is, const char *data, long length )
 {
+	prg->input_changes += 1;
 	is->funcs->prepend_data( prg, is, data, length );
 }
 
 void colm_stream_push_tree( struct colm_program *prg, struct input_impl *is, tree_t *tree, int ignore )
 {
+	prg->input_changes += 1;
 	is->funcs->prepend_tree( prg, is, tree, ignore );
 }
 
 void colm_stream_push_stream( struct colm_program *prg, struct input_impl *is, stream_t *stream )
 {
+	prg->input_changes += 1;
 	is->funcs->prepend_stream( prg, is, stream );
 }
 
 void colm_undo_stream_push( program_t *prg, tree_t **sp, struct input_impl *is, long length )
 {
+	prg->input_changes += 1;
+
 	if ( length < 0 ) {
 		/* tree_t *tree = */ is->funcs->undo_prepend_tree( prg, is );
 		// colm_tree_downref( prg, sp, tree );
@@ -205,11 +412,18 @@ static void send_back_ignore( program_t *prg, tree_t **sp,
 	head_t *head = parse_tree->shadow->tree->tokdata;
 	int artificial = parse_tree->flags & PF_ARTIFICIAL;
 
+	if ( prg->bt_profile != 0 )
+		bt_profile_send_back( prg->bt_profile, parse_tree );
+
 	if ( head != 0 ) {
-		if ( artificial )
+		if ( artificial ) {
 			send_back_tree( prg, is, parse_tree->shadow->tree );
-		else
+			pda_run->position -= 1;
+		}
+		else {
 			send_back_text( prg, is, string_data( head ), head->length );
+			pda_run->position -= head->length;
+		}
 	}
 
 	colm_decrement_steps( pda_run );
@@ -248,6 +462,9 @@ static void send_back( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 	debug( prg, REALM_PARSE, "sending back: %s\n",
 			prg->rtd->lel_info[parse_tree->id].name );
 
+	if ( prg->bt_profile != 0 )
+		bt_profile_send_back( prg->bt_profile, parse_tree );
+
 	if ( parse_tree->flags & PF_NAMED ) {
 		/* Send the named lang el back first, then send back any leading
 		 * whitespace. */
@@ -268,6 +485,7 @@ static void send_back( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 		colm_tree_upref( prg, parse_tree->shadow->tree );
 
 		send_back_tree( prg, is, parse_tree->shadow->tree );
+		pda_run->position -= 1;
 	}
 	else {
 		/* Check for reverse code. */
@@ -280,6 +498,7 @@ static void send_back( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 		/* Push back the token data. */
 		send_back_text( prg, is, string_data( parse_tree->shadow->tree->tokdata ), 
 				string_length( parse_tree->shadow->tree->tokdata ) );
+		pda_run->position -= string_length( parse_tree->shadow->tree->tokdata );
 
 		/* If eof was just sent back remember that it needs to be sent again. */
 		if ( parse_tree->id == prg->rtd->eof_lel_ids[pda_run->parser_id] )
@@ -404,9 +623,13 @@ static void report_parse_error( program_t *prg, tree_t **sp, struct pda_run *pda
 
 	head_t *error_head = 0;
 
+	/* Without locations there is no position to report. */
+	if ( deepest == 0 && pda_run->no_locations ) {
+		error_head = string_alloc_full( prg, "<input>: parse error", 20 );
+	}
 	/* If there are no error points on record assume the error occurred at the
 	 * beginning of the stream. */
-	if ( deepest == 0 )  {
+	else if ( deepest == 0 )  {
 		error_head = string_alloc_full( prg, "<input>:1:1: parse error", 32 );
 		error_head->location = location_allocate( prg );
 		error_head->location->line = 1;
@@ -416,6 +639,8 @@ static void report_parse_error( program_t *prg, tree_t **sp, struct pda_run *pda
 		debug( prg, REALM_PARSE, "deepest location byte: %d\n",
 				deepest->location->byte );
 
+		colm_location_resolve( deepest->location );
+
 		const char *name = deepest->location->name;
 		long line = deepest->location->line;
 		long i, column = deepest->location->column;
@@ -722,33 +947,53 @@ static void handle_error( program_t *prg, tree_t **sp, struct pda_run *pda_run )
 	}
 }
 
-static head_t *extract_match( program_t *prg, tree_t **sp,
-		struct pda_run *pda_run, struct input_impl *is )
+/* Token data for a match. Points into the input when it can keep the bytes
+ * for us, otherwise they are copied into the consume buffer. If the bytes
+ * are in an input buffer it is returned in prb for the token to pin. */
+static const char *extract_data( program_t *prg, struct pda_run *pda_run,
+		struct input_impl *is, long length, struct run_buf **prb )
 {
-	long length = pda_run->toklen;
-
-	//debug( prg, REALM_PARSE, "extracting token of length: %ld\n", length );
+	*prb = 0;
+	if ( is->funcs->get_data_ptr != 0 ) {
+		const char *ptr = is->funcs->get_data_ptr( prg, is, length, prb );
+		if ( ptr != 0 )
+			return ptr;
+	}
 
 	struct run_buf *run_buf = pda_run->consume_buf;
-	if ( run_buf == 0 || length > ( FSM_BUFSIZE - run_buf->length ) ) {
-		run_buf = new_run_buf( length );
+	if ( run_buf == 0 || length > ( run_buf->size - run_buf->length ) ) {
+		run_buf = new_run_buf( prg, length );
 		run_buf->next = pda_run->consume_buf;
 		pda_run->consume_buf = run_buf;
 	}
 
 	char *dest = run_buf->data + run_buf->length;
-
 	is->funcs->get_data( prg, is, dest, length );
+	run_buf->length += length;
+
+	return dest;
+}
+
+static head_t *extract_match( program_t *prg, tree_t **sp,
+		struct pda_run *pda_run, struct input_impl *is )
+{
+	long length = pda_run->toklen;
+
+	//debug( prg, REALM_PARSE, "extracting token of length: %ld\n", length );
+
+	struct run_buf *run_buf;
+	const char *dest = extract_data( prg, pda_run, is, length, &run_buf );
+
 	location_t *location = location_allocate( prg );
 	is->funcs->consume_data( prg, is, length, location );
-
-	run_buf->length += length;
+	pda_run->position += length;
 
 	pda_run->p = pda_run->pe = 0;
 	pda_run->toklen = 0;
 	pda_run->tokstart = 0;
 
 	head_t *head = colm_string_alloc_pointer( prg, dest, length );
+	string_pin( head, run_buf );
 
 	head->location = location;
 
@@ -765,6 +1010,7 @@ static head_t *extract_no_d( program_t *prg, tree_t **sp,
 	/* Just a consume, no data allocate. */
 	location_t *location = location_allocate( prg );
 	is->funcs->consume_data( prg, is, length, location );
+	pda_run->position += length;
 
 	pda_run->p = pda_run->pe = 0;
 	pda_run->toklen = 0;
@@ -786,29 +1032,21 @@ static head_t *extract_no_l( program_t *prg, tree_t **sp,
 
 	//debug( prg, REALM_PARSE, "extracting token of length: %ld\n", length );
 
-	struct run_buf *run_buf = pda_run->consume_buf;
-	if ( run_buf == 0 || length > ( FSM_BUFSIZE - run_buf->length ) ) {
-		run_buf = new_run_buf( length );
-		run_buf->next = pda_run->consume_buf;
-		pda_run->consume_buf = run_buf;
-	}
-
-	char *dest = run_buf->data + run_buf->length;
-
-	is->funcs->get_data( prg, is, dest, length );
+	struct run_buf *run_buf;
+	const char *dest = extract_data( prg, pda_run, is, length, &run_buf );
 
 	/* Using a dummpy location. */
 	location_t location;
 	memset( &location, 0, sizeof( location ) );
 	is->funcs->consume_data( prg, is, length, &location );
-
-	run_buf->length += length;
+	pda_run->position += length;
 
 	pda_run->p = pda_run->pe = 0;
 	pda_run->toklen = 0;
 	pda_run->tokstart = 0;
 
 	head_t *head = colm_string_alloc_pointer( prg, dest, length );
+	string_pin( head, run_buf );
 
 	/* Don't pass the location. */
 	head->location = 0;
@@ -827,6 +1065,7 @@ static head_t *consume_match( program_t *prg, tree_t **sp,
 	location_t dummy_loc;
 	memset( &dummy_loc, 0, sizeof(dummy_loc) );
 	is->funcs->consume_data( prg, is, length, &dummy_loc );
+	pda_run->position += length;
 
 	pda_run->p = pda_run->pe = 0;
 	pda_run->toklen = 0;
@@ -843,8 +1082,8 @@ static head_t *peek_match( program_t *prg, struct pda_run *pda_run, struct input
 	long length = pda_run->toklen;
 
 	struct run_buf *run_buf = pda_run->consume_buf;
-	if ( run_buf == 0 || length > ( FSM_BUFSIZE - run_buf->length ) ) {
-		run_buf = new_run_buf( 0 );
+	if ( run_buf == 0 || length > ( run_buf->size - run_buf->length ) ) {
+		run_buf = new_run_buf( prg, length );
 		run_buf->next = pda_run->consume_buf;
 		pda_run->consume_buf = run_buf;
 	}
@@ -877,7 +1116,9 @@ static void send_ignore( program_t *prg, tree_t **sp,
 		debug( prg, REALM_PARSE, "ignoring: %s\n", prg->rtd->lel_info[id].name );
 
 		/* Make the ignore string. */
-		head_t *ignore_str = extract_match( prg, sp, pda_run, is );
+		head_t *ignore_str = pda_run->no_locations ?
+				extract_no_l( prg, sp, pda_run, is ) :
+				extract_match( prg, sp, pda_run, is );
 
 		debug( prg, REALM_PARSE, "ignoring: %.*s\n", ignore_str->length, ignore_str->data );
 
@@ -899,6 +1140,8 @@ static void send_token( program_t *prg, tree_t **sp,
 	/* Make the token data. */
 	head_t *tokdata = 0;
 	int rn = prg->rtd->reducer_need_tok( prg, pda_run, id );
+	if ( pda_run->no_locations )
+		rn &= ~RN_LOC;
 
 	switch ( rn ) {
 		case RN_NONE:
@@ -939,6 +1182,7 @@ static void send_tree( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 {
 	kid_t *input = kid_allocate( prg );
 	input->tree = is->funcs->consume_tree( prg, is );
+	pda_run->position += 1;
 
 	colm_increment_steps( pda_run );
 
@@ -954,6 +1198,7 @@ static void send_ignore_tree( program_t *prg, tree_t **sp,
 		struct pda_run *pda_run, struct input_impl *is )
 {
 	tree_t *tree = is->funcs->consume_tree( prg, is );
+	pda_run->position += 1;
 	ignore_tree_art( prg, pda_run, tree );
 }
 
@@ -1078,6 +1323,529 @@ static void push_bt_point( program_t *prg, struct pda_run *pda_run )
 	}
 }
 
+/*
+ * Failed alternatives. When a token's alternative is taken a frame is pushed.
+ * If backtracking comes back to the token without code having run, the
+ * alternative failed for every parse of the input after it. That holds
+ * wherever the parser is in the same state at the same input position with
+ * the same states under it, down as far as the attempt reduced.
+ */
+
+static unsigned long bt_memo_hash( long state, long position, long id, int alt )
+{
+	unsigned long h = (unsigned long)position;
+	h = h * 31 + (unsigned long)state;
+	h = h * 31 + (unsigned long)id;
+	h = h * 31 + (unsigned long)alt;
+	return h % BT_MEMO_BUCKETS;
+}
+
+static void bt_memo_clear_frames( struct bt_memo *memo )
+{
+	while ( memo->frame != 0 ) {
+		struct bt_memo_frame *prev = memo->frame->prev;
+		free( memo->frame );
+		memo->frame = prev;
+	}
+}
+
+static void bt_memo_clear_els( program_t *prg, tree_t **sp, struct bt_memo *memo )
+{
+	long b;
+	if ( memo->table == 0 )
+		return;
+
+	for ( b = 0; b < BT_MEMO_BUCKETS; b++ ) {
+		struct bt_memo_el *el = memo->table[b];
+		while ( el != 0 ) {
+			struct bt_memo_el *next = el->next;
+			colm_tree_downref( prg, sp, el->deepest );
+			free( el );
+			el = next;
+		}
+		memo->table[b] = 0;
+	}
+	memo->num_els = 0;
+}
+
+static void bt_memo_free( program_t *prg, tree_t **sp, struct pda_run *pda_run )
+{
+	struct bt_memo *memo = pda_run->bt_memo;
+	if ( memo != 0 ) {
+		bt_memo_clear_frames( memo );
+		bt_memo_clear_els( prg, sp, memo );
+		free( memo->table );
+		free( memo );
+		pda_run->bt_memo = 0;
+	}
+}
+
+/* Code ran, the outcome of the alternative being tried may depend on it. */
+static void bt_memo_impure( struct pda_run *pda_run )
+{
+	if ( pda_run->bt_memo != 0 && pda_run->bt_memo->frame != 0 )
+		pda_run->bt_memo->frame->pure = false;
+}
+
+static struct bt_memo_el *bt_memo_find( struct bt_memo *memo, parse_tree_t *stack_top,
+		long state, long position, long id, int alt )
+{
+	struct bt_memo_el *el = memo->table[bt_memo_hash( state, position, id, alt )];
+	for ( ; el != 0; el = el->next ) {
+		if ( el->state == state && el->position == position &&
+				el->id == id && el->alt == alt )
+		{
+			parse_tree_t *under = stack_top;
+			int d;
+			for ( d = 0; d < el->depth && under != 0; d++ ) {
+				if ( under->state != el->under[d] )
+					break;
+				under = under->next;
+			}
+
+			if ( d == el->depth )
+				return el;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Called with the action about to be taken for a terminal that has
+ * alternatives after it. Moves past alternatives known to fail and starts a
+ * frame if there are still alternatives after the one taken.
+ */
+static unsigned int *bt_memo_take( program_t *prg, tree_t **sp,
+		struct pda_run *pda_run, unsigned int *action )
+{
+	struct bt_memo *memo = pda_run->bt_memo;
+	parse_tree_t *lel = pda_run->lel;
+
+	if ( lel->next != 0 || pda_run->target_steps >= 0 )
+		return action;
+
+	if ( memo == 0 ) {
+		memo = (struct bt_memo*) malloc( sizeof(struct bt_memo) );
+		memset( memo, 0, sizeof(struct bt_memo) );
+		memo->table = (struct bt_memo_el**) calloc( BT_MEMO_BUCKETS,
+				sizeof(struct bt_memo_el*) );
+		memo->input_changes = prg->input_changes;
+		pda_run->bt_memo = memo;
+	}
+
+	if ( memo->input_changes != prg->input_changes ) {
+		bt_memo_clear_els( prg, sp, memo );
+		memo->input_changes = prg->input_changes;
+	}
+
+	while ( action[1] != 0 ) {
+		struct bt_memo_el *el = bt_memo_find( memo, pda_run->stack_top,
+				pda_run->cur_state, pda_run->position, lel->id, lel->retry_lower );
+		if ( el == 0 )
+			break;
+
+		debug( prg, REALM_PARSE, "skipping failed alternative %d\n", el->alt );
+
+		if ( el->deepest != 0 ) {
+			kid_t *kid = kid_allocate( prg );
+			kid->tree = el->deepest;
+			colm_tree_upref( prg, el->deepest );
+			kid->next = pda_run->bt_point;
+			pda_run->bt_point = kid;
+		}
+
+		action += 1;
+		lel->retry_lower += 1;
+	}
+
+	if ( action[1] != 0 ) {
+		struct bt_memo_frame *frame = (struct bt_memo_frame*)
+				malloc( sizeof(struct bt_memo_frame) );
+		frame->prev = memo->frame;
+		frame->lel = lel;
+		frame->state = pda_run->cur_state;
+		frame->position = pda_run->position;
+		frame->alt = lel->retry_lower;
+		frame->floor = pda_run->stack_top;
+		frame->depth = 0;
+		frame->pure = true;
+		frame->bt_point = pda_run->bt_point;
+		frame->input_changes = prg->input_changes;
+		memo->frame = frame;
+	}
+
+	return action;
+}
+
+/* A reduction is about to pop rhs_len elements. Frames whose floor goes with
+ * them now depend on more of the stack. */
+static void bt_memo_reduce( struct pda_run *pda_run, int rhs_len )
+{
+	struct bt_memo_frame *frame = pda_run->bt_memo->frame;
+	while ( frame != 0 ) {
+		parse_tree_t *el = pda_run->stack_top;
+		int j = 0;
+		while ( j < rhs_len && el != frame->floor ) {
+			el = el->next;
+			j += 1;
+		}
+
+		if ( j == rhs_len )
+			break;
+
+		while ( j < rhs_len ) {
+			el = el->next;
+			j += 1;
+			frame->depth += 1;
+		}
+		frame->floor = el;
+		frame = frame->prev;
+	}
+}
+
+/* Backtracking has come back to a token with an alternative left. The one
+ * taken before failed. */
+static void bt_memo_retry( program_t *prg, tree_t **sp, struct pda_run *pda_run )
+{
+	struct bt_memo *memo = pda_run->bt_memo;
+	struct bt_memo_frame *frame = memo->frame;
+
+	if ( frame == 0 )
+		return;
+
+	if ( frame->lel != pda_run->parse_input || pda_run->target_steps >= 0 ) {
+		bt_memo_clear_frames( memo );
+		return;
+	}
+
+	memo->frame = frame->prev;
+	if ( !frame->pure && memo->frame != 0 )
+		memo->frame->pure = false;
+
+	if ( frame->pure && frame->depth <= BT_MEMO_DEPTH &&
+			frame->input_changes == prg->input_changes &&
+			memo->input_changes == prg->input_changes )
+	{
+		if ( memo->num_els >= BT_MEMO_MAX )
+			bt_memo_clear_els( prg, sp, memo );
+
+		struct bt_memo_el *el = (struct bt_memo_el*)
+				malloc( sizeof(struct bt_memo_el) );
+		el->state = frame->state;
+		el->position = frame->position;
+		el->id = frame->lel->id;
+		el->alt = frame->alt;
+		el->depth = frame->depth;
+
+		parse_tree_t *under = pda_run->stack_top;
+		int d;
+		for ( d = 0; d < frame->depth; d++ ) {
+			el->under[d] = under->state;
+			under = under->next;
+		}
+
+		/* Pick the error point the report would, from those the attempt
+		 * added. */
+		el->deepest = 0;
+		kid_t *kid;
+		for ( kid = pda_run->bt_point; kid != frame->bt_point; kid = kid->next ) {
+			head_t *head = kid->tree->tokdata;
+			if ( head != 0 && head->location != 0 ) {
+				if ( el->deepest == 0 || head->location->byte >
+						el->deepest->tokdata->location->byte )
+					el->deepest = kid->tree;
+			}
+		}
+		colm_tree_upref( prg, el->deepest );
+
+		long b = bt_memo_hash( el->state, el->position, el->id, el->alt );
+		el->next = memo->table[b];
+		memo->table[b] = el;
+		memo->num_els += 1;
+	}
+
+	free( frame );
+}
+
+static int in_loop_ranges( unsigned char c, const unsigned char *ranges )
+{
+	int i, n = ranges[0];
+	for ( i = 0; i < n; i++ ) {
+		if ( (unsigned char)( c - ranges[1+i*2] ) <=
+				(unsigned char)( ranges[2+i*2] - ranges[1+i*2] ) )
+			return 1;
+	}
+	return 0;
+}
+
+/* Advance p over bytes in the ranges of a self-looping scanner state. Returns
+ * the first byte outside the ranges, or pe. */
+char *colm_skip_loop( char *p, char *pe, const unsigned char *ranges )
+{
+#if defined(__SSE2__)
+	if ( pe - p >= 16 && in_loop_ranges( *p, ranges ) ) {
+		int i, n = ranges[0];
+		__m128i low[MAX_LOOP_RANGES], span[MAX_LOOP_RANGES];
+		const __m128i bias = _mm_set1_epi8( (char)0x80 );
+
+		/* Unsigned compares done as signed ones with the high bit flipped. */
+		for ( i = 0; i < n; i++ ) {
+			low[i] = _mm_set1_epi8( (char)ranges[1+i*2] );
+			span[i] = _mm_set1_epi8( (char)( ( ranges[2+i*2] - ranges[1+i*2] ) ^ 0x80 ) );
+		}
+
+		while ( pe - p >= 16 ) {
+			__m128i v = _mm_loadu_si128( (const __m128i*)p );
+			__m128i out = _mm_cmpeq_epi8( v, v );
+			int mask;
+
+			for ( i = 0; i < n; i++ ) {
+				__m128i d = _mm_xor_si128( _mm_sub_epi8( v, low[i] ), bias );
+				out = _mm_and_si128( out, _mm_cmpgt_epi8( d, span[i] ) );
+			}
+
+			mask = _mm_movemask_epi8( out );
+			if ( mask != 0 )
+				return p + __builtin_ctz( mask );
+			p += 16;
+		}
+	}
+#endif
+
+	while ( p < pe && in_loop_ranges( *p, ranges ) )
+		p += 1;
+	return p;
+}
+
+static void exec_fsm_action( struct pda_run *pda_run, const long *code )
+{
+	while ( true ) {
+		switch ( *code++ ) {
+		case FSM_OP_END:
+			return;
+		case FSM_OP_SET_ACT_ID:
+			pda_run->act = *code++;
+			break;
+		case FSM_OP_SET_TOKEND:
+			pda_run->tokend = pda_run->toklen + ( pda_run->p - pda_run->start ) + 1;
+			break;
+		case FSM_OP_INIT_ACT:
+			pda_run->act = 0;
+			break;
+		case FSM_OP_SET_TOKSTART:
+			pda_run->tokstart = pda_run->p;
+			break;
+		case FSM_OP_LM_SWITCH: {
+			const long *tokens = pda_run->fsm_tables->lm_switch_tokens + code[0];
+			long length = code[1];
+
+			/* If the switch handles error then we also forced the error state. It
+			 * will exist. */
+			pda_run->toklen = pda_run->tokend;
+			if ( code[2] && pda_run->act == 0 )
+				pda_run->fsm_cs = pda_run->fsm_tables->error_state;
+			else if ( 0 <= pda_run->act && pda_run->act < length && tokens[pda_run->act] >= 0 )
+				pda_run->matched_token = tokens[pda_run->act];
+
+			code += 3;
+			pda_run->return_result = true;
+			pda_run->skip_toklen = true;
+			break;
+		}
+		case FSM_OP_ON_LAST:
+			pda_run->p += 1;
+			pda_run->matched_token = *code++;
+			pda_run->return_result = true;
+			break;
+		case FSM_OP_ON_NEXT:
+			pda_run->matched_token = *code++;
+			pda_run->return_result = true;
+			break;
+		case FSM_OP_ON_LAG_BEHIND:
+			pda_run->toklen = pda_run->tokend;
+			pda_run->matched_token = *code++;
+			pda_run->return_result = true;
+			pda_run->skip_toklen = true;
+			break;
+		case FSM_OP_MARK:
+			pda_run->mark[*code++] = pda_run->p;
+			break;
+		}
+	}
+}
+
+/* Table driven scanner. Used by the compiler, and by generated programs built
+ * to scan from tables. */
+void colm_table_fsm_execute( struct pda_run *pda_run, struct input_impl *is )
+{
+	int _klen;
+	unsigned int _trans;
+	const long *_acts;
+	unsigned int _nacts;
+	const char *_keys;
+	const long *_targs;
+	const long *_tacts;
+		
+	pda_run->start = pda_run->p;
+
+	/* With the flat layout transitions are found by id rather than by
+	 * position in the state's key lists. */
+	if ( pda_run->fsm_tables->flat_indicies != 0 ) {
+		_targs = pda_run->fsm_tables->flat_trans_targs;
+		_tacts = pda_run->fsm_tables->flat_trans_actions;
+	}
+	else {
+		_targs = pda_run->fsm_tables->transTargsWI;
+		_tacts = pda_run->fsm_tables->transActionsWI;
+	}
+
+	/* Init the token match to nothing (the sentinal). */
+	pda_run->matched_token = 0;
+
+/*_resume:*/
+	if ( pda_run->fsm_cs == pda_run->fsm_tables->error_state )
+		goto out;
+
+	if ( pda_run->p == pda_run->pe )
+		goto out;
+
+_loop_head:
+	_acts = pda_run->fsm_tables->actions + pda_run->fsm_tables->from_state_actions[pda_run->fsm_cs];
+	_nacts = (unsigned int) *_acts++;
+	while ( _nacts-- > 0 )
+		exec_fsm_action( pda_run, pda_run->fsm_tables->action_code +
+				pda_run->fsm_tables->action_code_offsets[*_acts++] );
+
+	if ( pda_run->fsm_tables->flat_indicies != 0 ) {
+		/* Index directly by the character class. */
+		const unsigned char *_ckeys = pda_run->fsm_tables->flat_keys + (pda_run->fsm_cs<<1);
+		unsigned int _cls = pda_run->fsm_tables->char_class[(unsigned char)(*pda_run->p)];
+		_klen = pda_run->fsm_tables->flat_key_spans[pda_run->fsm_cs];
+		_trans = pda_run->fsm_tables->flat_index_offsets[pda_run->fsm_cs];
+
+		if ( _klen > 0 && _ckeys[0] <= _cls && _cls <= _ckeys[1] )
+			_trans = pda_run->fsm_tables->flat_indicies[_trans + _cls - _ckeys[0]];
+		else
+			_trans = pda_run->fsm_tables->flat_indicies[_trans + _klen];
+		goto _match;
+	}
+
+	_keys = pda_run->fsm_tables->trans_keys + pda_run->fsm_tables->key_offsets[pda_run->fsm_cs];
+	_trans = pda_run->fsm_tables->index_offsets[pda_run->fsm_cs];
+
+	_klen = pda_run->fsm_tables->single_lengths[pda_run->fsm_cs];
+	if ( _klen > 0 ) {
+		const char *_lower = _keys;
+		const char *_mid;
+		const char *_upper = _keys + _klen - 1;
+		while (1) {
+			if ( _upper < _lower )
+				break;
+
+			_mid = _lower + ((_upper-_lower) >> 1);
+			if ( (*pda_run->p) < *_mid )
+				_upper = _mid - 1;
+			else if ( (*pda_run->p) > *_mid )
+				_lower = _mid + 1;
+			else {
+				_trans += (_mid - _keys);
+				goto _match;
+			}
+		}
+		_keys += _klen;
+		_trans += _klen;
+	}
+
+	_klen = pda_run->fsm_tables->range_lengths[pda_run->fsm_cs];
+	if ( _klen > 0 ) {
+		const char *_lower = _keys;
+		const char *_mid;
+		const char *_upper = _keys + (_klen<<1) - 2;
+		while (1) {
+			if ( _upper < _lower )
+				break;
+
+			_mid = _lower + (((_upper-_lower) >> 1) & ~1);
+			if ( (*pda_run->p) < _mid[0] )
+				_upper = _mid - 2;
+			else if ( (*pda_run->p) > _mid[1] )
+				_lower = _mid + 2;
+			else {
+				_trans += ((_mid - _keys)>>1);
+				goto _match;
+			}
+		}
+		_trans += _klen;
+	}
+
+_match:
+	if ( _tacts[_trans] == 0 ) {
+		/* Pass over the rest of a run the state loops on. */
+		if ( _targs[_trans] == pda_run->fsm_cs &&
+				pda_run->fsm_tables->loop_offsets[pda_run->fsm_cs] != 0 )
+		{
+			pda_run->p = colm_skip_loop( pda_run->p + 1, pda_run->pe,
+					pda_run->fsm_tables->loop_ranges +
+					pda_run->fsm_tables->loop_offsets[pda_run->fsm_cs] ) - 1;
+		}
+		pda_run->fsm_cs = _targs[_trans];
+		goto _again;
+	}
+
+	pda_run->fsm_cs = _targs[_trans];
+
+	pda_run->return_result = false;
+	pda_run->skip_toklen = false;
+	_acts = pda_run->fsm_tables->actions + _tacts[_trans];
+	_nacts = (unsigned int) *_acts++;
+	while ( _nacts-- > 0 )
+		exec_fsm_action( pda_run, pda_run->fsm_tables->action_code +
+				pda_run->fsm_tables->action_code_offsets[*_acts++] );
+	if ( pda_run->return_result ) {
+		if ( pda_run->skip_toklen )
+			goto skip_toklen;
+		goto final;
+	}
+
+_again:
+	_acts = pda_run->fsm_tables->actions + pda_run->fsm_tables->to_state_actions[pda_run->fsm_cs];
+	_nacts = (unsigned int) *_acts++;
+	while ( _nacts-- > 0 )
+		exec_fsm_action( pda_run, pda_run->fsm_tables->action_code +
+				pda_run->fsm_tables->action_code_offsets[*_acts++] );
+
+	if ( pda_run->fsm_cs == pda_run->fsm_tables->error_state )
+		goto out;
+
+	if ( ++pda_run->p != pda_run->pe )
+		goto _loop_head;
+out:
+	if ( pda_run->scan_eof ) {
+		pda_run->return_result = false;
+		pda_run->skip_toklen = false;
+		_acts = pda_run->fsm_tables->actions + pda_run->fsm_tables->eof_actions[pda_run->fsm_cs];
+		_nacts = (unsigned int) *_acts++;
+
+		if ( pda_run->fsm_tables->eof_targs[pda_run->fsm_cs] >= 0 )
+			pda_run->fsm_cs = pda_run->fsm_tables->eof_targs[pda_run->fsm_cs];
+
+		while ( _nacts-- > 0 )
+			exec_fsm_action( pda_run, pda_run->fsm_tables->action_code +
+					pda_run->fsm_tables->action_code_offsets[*_acts++] );
+		if ( pda_run->return_result ) {
+			if ( pda_run->skip_toklen )
+				goto skip_toklen;
+			goto final;
+		}
+	}
+
+final:
+
+	if ( pda_run->p != 0 )
+		pda_run->toklen += pda_run->p - pda_run->start;
+skip_toklen:
+	{}
+}
 
 #define SCAN_UNDO              -7
 #define SCAN_IGNORE            -6
@@ -1282,6 +2050,8 @@ void colm_pda_clear( program_t *prg, tree_t **sp, struct pda_run *pda_run )
 
 	colm_tree_downref( prg, sp, pda_run->parse_error_text );
 
+	bt_memo_free( prg, sp, pda_run );
+
 	if ( pda_run->reducer ) {
 		long local_lost = pool_alloc_num_lost( &pda_run->local_pool );
 
@@ -1302,6 +2072,10 @@ void colm_pda_init( program_t *prg, struct pda_run *pda_run, struct pda_tables *
 	pda_run->revert_on = revert_on;
 	pda_run->target_steps = -1;
 	pda_run->reducer = reducer;
+	pda_run->no_locations = prg->no_locations;
+	pda_run->bt_memo_on = prg->bt_memo && stop_target <= 0;
+	pda_run->auto_commit = prg->auto_commit;
+	pda_run->auto_commit_at = prg->auto_commit;
 
 	/* An initial commit shift count of -1 means we won't ever back up to zero
 	 * shifts and think parsing cannot continue. */
@@ -1378,6 +2152,94 @@ static long stack_top_target( program_t *prg, struct pda_run *pda_run )
 	return state;
 }
 
+/* A commit fixes the input up to the last shifted token. The input queued for
+ * parsing and the ignores ahead of it can still be sent back. The input may
+ * drop what it keeps for undoing anything older. */
+static void commit_input( program_t *prg, struct pda_run *pda_run, struct input_impl *is )
+{
+	/* Undoing the whole parse sends back all of it. */
+	if ( pda_run->revert_on )
+		return;
+
+	long keep = 0;
+	parse_tree_t *pt;
+	for ( pt = pda_run->parse_input; pt != 0; pt = pt->next ) {
+		if ( pt->flags & PF_ARTIFICIAL )
+			keep += 1;
+		else if ( pt->shadow != 0 && pt->shadow->tree->tokdata != 0 )
+			keep += pt->shadow->tree->tokdata->length;
+	}
+	for ( pt = pda_run->accum_ignore; pt != 0; pt = pt->next ) {
+		if ( pt->shadow != 0 && pt->shadow->tree->tokdata != 0 )
+			keep += pt->shadow->tree->tokdata->length;
+	}
+
+	is->funcs->commit_consumed( prg, is, keep );
+}
+
+/* All input taken so far is parsed and nothing is left to backtrack into. A
+ * commit here cannot change the outcome, but frees what was kept for undoing
+ * it. */
+static void auto_commit( program_t *prg, tree_t **sp, struct pda_run *pda_run, struct input_impl *is )
+{
+	debug( prg, REALM_PARSE, "automatic commit at %ld\n", pda_run->position );
+
+	pda_run->auto_commit_at = pda_run->position + pda_run->auto_commit;
+	pda_run->commit_shift_count = pda_run->shift_count;
+	commit_input( prg, pda_run, is );
+
+	if ( pda_run->bt_memo != 0 ) {
+		bt_memo_clear_frames( pda_run->bt_memo );
+		bt_memo_clear_els( prg, sp, pda_run->bt_memo );
+	}
+
+	if ( pda_run->reducer )
+		commit_reduce( prg, sp, pda_run );
+	else
+		commit_clear( prg, sp, pda_run );
+
+	/* Reverse code belongs to trees on the stack, which are now out of
+	 * reach. */
+	if ( pda_run->rc_block_count == 0 )
+		colm_rcode_downref_all( prg, sp, &pda_run->reverse_code );
+
+	/* Only the last token is needed for recording error points. */
+	if ( pda_run->token_list != 0 ) {
+		ref_t *ref = pda_run->token_list->next;
+		while ( ref != 0 ) {
+			ref_t *next = ref->next;
+			kid_free( prg, (kid_t*)ref );
+			ref = next;
+		}
+		pda_run->token_list->next = 0;
+	}
+
+	/* Of the error points keep the one the report would pick. */
+	kid_t *deepest = 0, *kid = pda_run->bt_point;
+	for ( ; kid != 0; kid = kid->next ) {
+		head_t *head = kid->tree->tokdata;
+		if ( head != 0 && head->location != 0 ) {
+			if ( deepest == 0 || head->location->byte >
+					deepest->tree->tokdata->location->byte )
+				deepest = kid;
+		}
+	}
+
+	kid = pda_run->bt_point;
+	while ( kid != 0 ) {
+		kid_t *next = kid->next;
+		if ( kid != deepest ) {
+			colm_tree_downref( prg, sp, kid->tree );
+			kid_free( prg, kid );
+		}
+		kid = next;
+	}
+
+	pda_run->bt_point = deepest;
+	if ( deepest != 0 )
+		deepest->next = 0;
+}
+
 /*
  * shift:         retry goes into lower of shifted node.
  * reduce:        retry goes into upper of reduced node.
@@ -1415,35 +2277,53 @@ static long parse_token( program_t *prg, tree_t **sp,
 	pda_run->parse_input->state = pda_run->pda_cs;
 
 again:
-	if ( pda_run->parse_input == 0 )
+	if ( pda_run->parse_input == 0 ) {
+		if ( pda_run->auto_commit > 0 &&
+				pda_run->position >= pda_run->auto_commit_at &&
+				pda_run->num_retry == 0 && pda_run->target_steps < 0 )
+		{
+			auto_commit( prg, sp, pda_run, is );
+			if ( pda_run->fail_parsing )
+				goto fail;
+		}
 		goto _out;
+	}
 
 	pda_run->lel = pda_run->parse_input;
 	pda_run->cur_state = pda_run->pda_cs;
 
-	if ( pda_run->lel->id < pda_run->pda_tables->keys[pda_run->cur_state<<1] ||
-			pda_run->lel->id > pda_run->pda_tables->keys[(pda_run->cur_state<<1)+1] )
+	/* States that make only one reduction do so on any token. A token they
+	 * would not accept is caught in the state the reduction goes to. Ignores
+	 * waiting to be attached take the full lookup so the error point does
+	 * not move. */
+	pos = pda_run->pda_tables->default_inds[pda_run->cur_state];
+	if ( pos < 0 || pda_run->lel->id >= prg->rtd->first_non_term_id ||
+			pda_run->accum_ignore != 0 )
 	{
-		debug( prg, REALM_PARSE, "parse error, no transition 1\n" );
-		push_bt_point( prg, pda_run );
-		goto parse_error;
-	}
+		if ( pda_run->lel->id < pda_run->pda_tables->keys[pda_run->cur_state<<1] ||
+				pda_run->lel->id > pda_run->pda_tables->keys[(pda_run->cur_state<<1)+1] )
+		{
+			debug( prg, REALM_PARSE, "parse error, no transition 1\n" );
+			push_bt_point( prg, pda_run );
+			goto parse_error;
+		}
 
-	ind_pos = pda_run->pda_tables->offsets[pda_run->cur_state] + 
-		(pda_run->lel->id - pda_run->pda_tables->keys[pda_run->cur_state<<1]);
+		ind_pos = pda_run->pda_tables->offsets[pda_run->cur_state] + 
+			(pda_run->lel->id - pda_run->pda_tables->keys[pda_run->cur_state<<1]);
 
-	owner = pda_run->pda_tables->owners[ind_pos];
-	if ( owner != pda_run->cur_state ) {
-		debug( prg, REALM_PARSE, "parse error, no transition 2\n" );
-		push_bt_point( prg, pda_run );
-		goto parse_error;
-	}
+		owner = pda_run->pda_tables->owners[ind_pos];
+		if ( owner != pda_run->cur_state ) {
+			debug( prg, REALM_PARSE, "parse error, no transition 2\n" );
+			push_bt_point( prg, pda_run );
+			goto parse_error;
+		}
 
-	pos = pda_run->pda_tables->indicies[ind_pos];
-	if ( pos < 0 ) {
-		debug( prg, REALM_PARSE, "parse error, no transition 3\n" );
-		push_bt_point( prg, pda_run );
-		goto parse_error;
+		pos = pda_run->pda_tables->indicies[ind_pos];
+		if ( pos < 0 ) {
+			debug( prg, REALM_PARSE, "parse error, no transition 3\n" );
+			push_bt_point( prg, pda_run );
+			goto parse_error;
+		}
 	}
 
 	/* Checking complete. */
@@ -1454,6 +2334,10 @@ again:
 	if ( pda_run->lel->retry_lower )
 		action += pda_run->lel->retry_lower;
 
+	if ( pda_run->bt_memo_on && action[1] != 0 &&
+			pda_run->lel->id < prg->rtd->first_non_term_id )
+		action = bt_memo_take( prg, sp, pda_run, action );
+
 	/*
 	 * Shift
 	 */
@@ -1508,6 +2392,12 @@ again:
 	if ( pda_run->pda_tables->commit_len[pos] != 0 ) {
 		debug( prg, REALM_PARSE, "commit point\n" );
 		pda_run->commit_shift_count = pda_run->shift_count;
+		commit_input( prg, pda_run, is );
+
+		if ( pda_run->bt_memo != 0 ) {
+			bt_memo_clear_frames( pda_run->bt_memo );
+			bt_memo_clear_els( prg, sp, pda_run->bt_memo );
+		}
 
 		/* Not in a reverting context and the parser result is not used. */
 		if ( pda_run->reducer )
@@ -1563,6 +2453,9 @@ again:
 		 * put the children under the new data tree. No need to alter refcounts
 		 * here. */
 		rhs_len = prg->rtd->prod_info[pda_run->reduction].length;
+		if ( pda_run->bt_memo != 0 && pda_run->bt_memo->frame != 0 )
+			bt_memo_reduce( pda_run, rhs_len );
+
 		child = last = 0;
 		data_child = data_last = 0;
 		for ( r = 0; r < rhs_len; r++ ) {
@@ -1611,6 +2504,7 @@ again:
 			pda_run->reject = false;
 			pda_run->parsed = 0;
 			pda_run->code = pda_run->fi->codeWV;
+			bt_memo_impure( pda_run );
 
 			/* COROUTINE */
 			return PCR_REDUCTION;
@@ -1681,6 +2575,11 @@ again:
 parse_error:
 	debug( prg, REALM_PARSE, "hit error, backtracking\n" );
 
+	if ( prg->bt_profile != 0 ) {
+		bt_profile_error( prg->bt_profile, pda_run->parse_input == 0 ?
+				pda_run->pda_cs : pda_run->cur_state );
+	}
+
 #if 0
 	if ( pda_run->num_retry == 0 ) {
 		debug( prg, REALM_PARSE, "out of retries failing parse\n" );
@@ -1693,8 +2592,17 @@ parse_error:
 			debug( prg, REALM_BYTECODE, "dropping out for reverse code call\n" );
 
 			pda_run->frame_id = -1;
+			long rcode_len = pda_run->reverse_code.tab_len;
 			pda_run->code = colm_pop_reverse_code( &pda_run->reverse_code );
 
+			if ( prg->bt_profile != 0 ) {
+				struct bt_profile *prof = prg->bt_profile;
+				rcode_len -= pda_run->reverse_code.tab_len + SIZEOF_WORD;
+				prof->rcode_bytes += rcode_len;
+				if ( prof->rcode_prod >= 0 )
+					prof->prods[prof->rcode_prod].rcode_bytes += rcode_len;
+			}
+
 			/* COROUTINE */
 			return PCR_REVERSE;
 			case PCR_REVERSE: 
@@ -1708,6 +2616,8 @@ parse_error:
 				debug( prg, REALM_PARSE, "found a new region\n" );
 				pda_run->num_retry -= 1;
 				pda_run->pda_cs = stack_top_target( prg, pda_run );
+				if ( prg->bt_profile != 0 )
+					bt_profile_charge( prg->bt_profile, pda_run->pda_cs, true, -1 );
 				pda_run->next_region_ind = pda_run->next;
 				return PCR_DONE;
 			}
@@ -1720,6 +2630,12 @@ parse_error:
 						"steps is %d\n", pda_run->steps );
 
 				pda_run->pda_cs = stack_top_target( prg, pda_run );
+				if ( prg->bt_profile != 0 ) {
+					bt_profile_charge( prg->bt_profile,
+							prg->bt_profile->error_state, false, -1 );
+				}
+				if ( pda_run->bt_memo != 0 )
+					bt_memo_clear_frames( pda_run->bt_memo );
 				goto _out;
 			}
 		}
@@ -1735,6 +2651,12 @@ parse_error:
 
 					pda_run->num_retry -= 1;
 					pda_run->pda_cs = pda_run->parse_input->state;
+					if ( prg->bt_profile != 0 ) {
+						bt_profile_charge( prg->bt_profile, pda_run->pda_cs,
+								true, pda_run->parse_input->id );
+					}
+					if ( pda_run->bt_memo != 0 )
+						bt_memo_retry( prg, sp, pda_run );
 					goto again;
 				}
 
@@ -1787,6 +2709,11 @@ parse_error:
 				pda_run->on_deck = true;
 				pda_run->parsed = 0;
 
+				if ( prg->bt_profile != 0 ) {
+					prg->bt_profile->rcode_prod = bt_profile_prod(
+							prg->bt_profile, pda_run->parse_input );
+				}
+
 				/* Only the RCODE flag was in the replaced lhs. All the rest is in
 				 * the the original. We read it after restoring. */
 
@@ -1797,6 +2724,11 @@ parse_error:
 				pda_run->undo_lel = pda_run->parse_input;
 				pda_run->parse_input = pda_run->parse_input->next;
 
+				if ( prg->bt_profile != 0 ) {
+					prg->bt_profile->prods[bt_profile_prod(
+							prg->bt_profile, pda_run->undo_lel )].undone += 1;
+				}
+
 				/* Extract children from the child list. */
 				parse_tree_t *first = pda_run->undo_lel->child;
 				pda_run->undo_lel->child = 0;
@@ -1930,6 +2862,12 @@ parse_error:
 	}
 
 fail:
+	if ( prg->bt_profile != 0 )
+		bt_profile_charge( prg->bt_profile, prg->bt_profile->error_state, false, -1 );
+
+	if ( pda_run->bt_memo != 0 )
+		bt_memo_clear_frames( pda_run->bt_memo );
+
 	pda_run->pda_cs = -1;
 	pda_run->parse_error = 1;
 
@@ -2014,6 +2952,7 @@ long colm_parse_loop( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 
 				pda_run->fi = &prg->rtd->frame_info[pda_run->frame_id];
 				pda_run->code = pda_run->fi->codeWV;
+				bt_memo_impure( pda_run );
 
 				/* COROUTINE */
 				return PCR_PRE_EOF;
@@ -2060,6 +2999,7 @@ long colm_parse_loop( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 
 			/* A named language element (parsing colm program). */
 			prg->rtd->send_named_lang_el( prg, sp, pda_run, is );
+			bt_memo_impure( pda_run );
 		}
 		else if ( pda_run->token_id == SCAN_TREE ) {
 			debug( prg, REALM_PARSE, "sending a tree\n" );
@@ -2092,6 +3032,7 @@ long colm_parse_loop( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 			pda_run->fi = &prg->rtd->frame_info[prg->rtd->lel_info[pda_run->token_id].frame_id];
 			pda_run->frame_id = prg->rtd->lel_info[pda_run->token_id].frame_id;
 			pda_run->code = pda_run->fi->codeWV;
+			bt_memo_impure( pda_run );
 			
 			/* COROUTINE */
 			return PCR_GENERATION;
@@ -23,6 +23,8 @@
 #ifndef _COLM_PDARUN_H
 #define _COLM_PDARUN_H
 
+#include <string.h>
+
 #include <colm/input.h>
 #include <colm/defs.h>
 #include <colm/tree.h>
@@ -36,6 +38,21 @@ struct colm_program;
 
 #define MARK_SLOTS 32
 
+/* Most byte ranges a state can skip over in one pass. */
+#define MAX_LOOP_RANGES 4
+
+/* Opcodes of the lowered scanner actions. Operands follow the opcode. */
+#define FSM_OP_END             0
+#define FSM_OP_SET_ACT_ID      1  /* act id */
+#define FSM_OP_SET_TOKEND      2
+#define FSM_OP_INIT_ACT        3
+#define FSM_OP_SET_TOKSTART    4
+#define FSM_OP_LM_SWITCH       5  /* token offset, length, handles error */
+#define FSM_OP_ON_LAST         6  /* token */
+#define FSM_OP_ON_NEXT         7  /* token */
+#define FSM_OP_ON_LAG_BEHIND   8  /* token */
+#define FSM_OP_MARK            9  /* mark slot */
+
 struct fsm_tables
 {
 	long *actions;
@@ -68,6 +85,39 @@ struct fsm_tables
 
 	struct GenAction **action_switch;
 	long num_action_switch;
+
+	/* Actions lowered to opcodes, with offsets by action id. Longest-match
+	 * switches index a table from act id to token, -1 where there is none. */
+	long *action_code;
+	long *action_code_offsets;
+	long *lm_switch_tokens;
+	long num_action_code;
+	long num_lm_switch_tokens;
+
+	/* Alphabet compression. Maps each byte to a class of keys that no state
+	 * distinguishes. */
+	unsigned char *char_class;
+	long num_char_classes;
+
+	/* Flat layout, indexed by character class. Each state indexes a dense
+	 * span of transitions between its low and high class. Classes outside the
+	 * span take the transition stored just past the end of it. Indicies are
+	 * transition ids. */
+	unsigned char *flat_keys;
+	long *flat_key_spans;
+	long *flat_index_offsets;
+	long *flat_indicies;
+	long *flat_trans_targs;
+	long *flat_trans_actions;
+
+	long num_flat_indicies;
+	long num_flat_trans;
+
+	/* Self loops. Offsets by state into the ranges, zero if the state has
+	 * none. Each list is a count followed by low/high byte pairs. */
+	long *loop_offsets;
+	unsigned char *loop_ranges;
+	long num_loop_ranges;
 };
 
 #if SIZEOF_LONG != 4 && SIZEOF_LONG != 8 
@@ -223,6 +273,7 @@ struct pda_tables
 	unsigned int *act_inds;
 	unsigned int *actions;
 	int *commit_len;
+	int *default_inds;
 	int *token_region_inds;
 	int *token_regions;
 	int *token_pre_regions;
@@ -238,6 +289,106 @@ struct pda_tables
 	int num_pre_region_items;
 };
 
+/* Backtracking done in a parser state. The work of undoing a failed
+ * alternative is charged to the state where the next alternative was taken
+ * up, or to the state of the error if there was none. */
+struct bt_state_prof
+{
+	unsigned long errors;
+	unsigned long retries;
+	unsigned long sent_back;
+	unsigned long rescan_bytes;
+	unsigned long rcode_bytes;
+
+	/* Language element the last alternative was taken up on. */
+	long lel_id;
+};
+
+/* Reductions of a production that were undone and the reverse code they
+ * ran. */
+struct bt_prod_prof
+{
+	unsigned long undone;
+	unsigned long rcode_bytes;
+};
+
+struct bt_profile
+{
+	char *file;
+
+	long num_states;
+	struct bt_state_prof *states;
+
+	long num_prods;
+	struct bt_prod_prof *prods;
+
+	/* Production index from the lhs and production number of a tree. */
+	long *lel_prods;
+	long *prod_index;
+
+	/* The undoing in progress. */
+	long error_state;
+	unsigned long sent_back;
+	unsigned long rescan_bytes;
+	unsigned long rcode_bytes;
+	long rcode_prod;
+};
+
+/* Alternatives that failed are remembered with the states of the stack
+ * elements the attempt reduced away, at most this many. */
+#define BT_MEMO_DEPTH 16
+#define BT_MEMO_BUCKETS 4096
+#define BT_MEMO_MAX 16384
+
+struct bt_memo_el
+{
+	struct bt_memo_el *next;
+
+	long state;
+	long position;
+	long id;
+	int alt;
+
+	int depth;
+	long under[BT_MEMO_DEPTH];
+
+	/* Deepest error point the alternative reached. Passed on to the error
+	 * report when it is skipped. */
+	tree_t *deepest;
+};
+
+/* An alternative being tried. Floor is the highest element of the stack it
+ * started on that has not been reduced away, and depth counts those that
+ * have. Pure attempts ran no code. */
+struct bt_memo_frame
+{
+	struct bt_memo_frame *prev;
+
+	parse_tree_t *lel;
+	long state;
+	long position;
+	int alt;
+
+	parse_tree_t *floor;
+	int depth;
+	int pure;
+
+	kid_t *bt_point;
+	long input_changes;
+};
+
+struct bt_memo
+{
+	struct bt_memo_el **table;
+	long num_els;
+
+	/* The input changes under the remembered positions when code pushes to
+	 * or pulls from it. */
+	long input_changes;
+
+	struct bt_memo_frame *frame;
+};
+
 struct pool_block
 {
 	void *data;
@@ -324,6 +475,12 @@ struct pda_run
 	long shift_count;
 	long commit_shift_count;
 
+	/* Commit without a commit point in the grammar once this much input has
+	 * been taken since the last automatic commit, as soon as there are no
+	 * alternatives left to try. Zero turns it off. */
+	long auto_commit;
+	long auto_commit_at;
+
 	int on_deck;
 
 	/*
@@ -370,6 +527,15 @@ struct pda_run
 
 	/* Disregard any alternate parse paths, just go right to failure. */
 	int fail_parsing;
+
+	/* Tokens get no location, whatever the reducer needs. */
+	int no_locations;
+
+	/* Input taken by the parser, in bytes and trees, less what was sent
+	 * back. Alternatives known to fail are kept in memo when enabled. */
+	long position;
+	int bt_memo_on;
+	struct bt_memo *bt_memo;
 };
 
 void colm_pda_init( struct colm_program *prg, struct pda_run *pda_run,
@@ -379,10 +545,15 @@ void colm_pda_init( struct colm_program *prg, struct pda_run *pda_run,
 void colm_pda_clear( struct colm_program *prg, struct colm_tree **sp,
 		struct pda_run *pda_run );
 
+struct bt_profile *colm_bt_profile_new( struct colm_program *prg, const char *file );
+void colm_bt_profile_write( struct colm_program *prg, struct bt_profile *prof );
+void colm_bt_profile_free( struct bt_profile *prof );
+
 void colm_rt_code_vect_replace( struct rt_code_vect *vect, long pos,
 		const code_t *val, long len );
 void colm_rt_code_vect_empty( struct rt_code_vect *vect );
 void colm_rt_code_vect_remove( struct rt_code_vect *vect, long pos, long len );
+void colm_rt_code_vect_grow( struct rt_code_vect *vect, long len );
 
 void init_rt_code_vect( struct rt_code_vect *code_vect );
 
@@ -391,41 +562,56 @@ inline static void append_code_vect( struct rt_code_vect *vect, const code_t *va
 inline static void append_half( struct rt_code_vect *vect, half_t half );
 inline static void append_word( struct rt_code_vect *vect, word_t word );
 
+/* Reserve len elements at the end and return where they start. Space is only
+ * given back when the vector is emptied. */
+inline static code_t *rt_code_vect_extend( struct rt_code_vect *vect, long len )
+{
+	if ( vect->tab_len + len > vect->alloc_len )
+		colm_rt_code_vect_grow( vect, vect->tab_len + len );
+
+	code_t *dest = vect->data + vect->tab_len;
+	vect->tab_len += len;
+	return dest;
+}
+
 inline static void append_code_vect( struct rt_code_vect *vect, const code_t *val, long len )
 {
-	colm_rt_code_vect_replace( vect, vect->tab_len, val, len );
+	memcpy( rt_code_vect_extend( vect, len ), val, sizeof(code_t) * len );
 }
 
 inline static void append_code_val( struct rt_code_vect *vect, const code_t val )
 {
-	colm_rt_code_vect_replace( vect, vect->tab_len, &val, 1 );
+	*rt_code_vect_extend( vect, 1 ) = val;
 }
 
 inline static void append_half( struct rt_code_vect *vect, half_t half )
 {
-	/* not optimal. */
-	append_code_val( vect, half & 0xff );
-	append_code_val( vect, (half>>8) & 0xff );
+	code_t *dest = rt_code_vect_extend( vect, 2 );
+	dest[0] = half & 0xff;
+	dest[1] = (half>>8) & 0xff;
 }
 
 inline static void append_word( struct rt_code_vect *vect, word_t word )
 {
-	/* not optimal. */
-	append_code_val( vect, word & 0xff );
-	append_code_val( vect, (word>>8) & 0xff );
-	append_code_val( vect, (word>>16) & 0xff );
-	append_code_val( vect, (word>>24) & 0xff );
+	code_t *dest = rt_code_vect_extend( vect, sizeof(word_t) );
+	dest[0] = word & 0xff;
+	dest[1] = (word>>8) & 0xff;
+	dest[2] = (word>>16) & 0xff;
+	dest[3] = (word>>24) & 0xff;
 	#if SIZEOF_LONG == 8
-	append_code_val( vect, (word>>32) & 0xff );
-	append_code_val( vect, (word>>40) & 0xff );
-	append_code_val( vect, (word>>48) & 0xff );
-	append_code_val( vect, (word>>56) & 0xff );
+	dest[4] = (word>>32) & 0xff;
+	dest[5] = (word>>40) & 0xff;
+	dest[6] = (word>>48) & 0xff;
+	dest[7] = (word>>56) & 0xff;
 	#endif
 }
 
 void colm_increment_steps( struct pda_run *pda_run );
 void colm_decrement_steps( struct pda_run *pda_run );
 
+char *colm_skip_loop( char *p, char *pe, const unsigned char *ranges );
+void colm_table_fsm_execute( struct pda_run *pda_run, struct input_impl *is );
+
 void colm_clear_stream_impl( struct colm_program *prg, tree_t **sp, struct stream_impl *input_stream );
 
 #define PCR_START         1
@@ -463,6 +649,8 @@ void commit_clear_parse_tree( program_t *prg, tree_t **sp,
 		struct pda_run *pda_run, parse_tree_t *pt );
 void commit_reduce( program_t *prg, tree_t **root,
 		struct pda_run *pda_run );
+void commit_clear( program_t *prg, tree_t **root,
+		struct pda_run *pda_run );
 
 tree_t *get_parsed_root( struct pda_run *pda_run, int stop );
 
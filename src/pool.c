@@ -246,3 +246,27 @@ long location_num_lost( program_t *prg )
 {
 	return pool_alloc_num_lost( &prg->location_pool );
 }
+
+/* 
+ * struct seq_buf
+ */
+
+struct seq_buf *seq_buf_allocate( program_t *prg )
+{
+	return (struct seq_buf*) pool_alloc_allocate( &prg->seq_buf_pool );
+}
+
+void seq_buf_free( program_t *prg, struct seq_buf *el )
+{
+	pool_alloc_free( &prg->seq_buf_pool, el );
+}
+
+void seq_buf_clear( program_t *prg )
+{
+	pool_alloc_clear( &prg->seq_buf_pool );
+}
+
+long seq_buf_num_lost( program_t *prg )
+{
+	return pool_alloc_num_lost( &prg->seq_buf_pool );
+}
@@ -62,6 +62,11 @@ void location_free( program_t *prg, location_t *el );
 void location_clear( program_t *prg );
 long location_num_lost( program_t *prg );
 
+struct seq_buf *seq_buf_allocate( program_t *prg );
+void seq_buf_free( program_t *prg, struct seq_buf *el );
+void seq_buf_clear( program_t *prg );
+long seq_buf_num_lost( program_t *prg );
+
 void pool_alloc_clear( struct pool_alloc *pool_alloc );
 long pool_alloc_num_lost( struct pool_alloc *pool_alloc );
 
@@ -102,7 +102,7 @@ void append_collect( struct colm_print_args *args, const char *data, int length
 void append_file( struct colm_print_args *args, const char *data, int length )
 {
 	struct stream_impl_data *impl = (struct stream_impl_data*) args->arg;
-	fwrite( data, 1, length, impl->file );
+	stream_impl_write( impl, data, length );
 }
 
 static void out_indent( struct colm_print_args *args, const char *data, int length )
@@ -673,6 +673,7 @@ static void postfix_term( program_t *prg, tree_t **sp,
 				args->out( args, " 0 0 0 ", 7 );
 			}
 			else {
+				colm_location_resolve( loc );
 				sprintf( buf, " %ld %ld %ld ", loc->line, loc->column, loc->byte );
 				args->out( args, buf, strlen( buf ) );
 			}
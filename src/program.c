@@ -175,6 +175,87 @@ void colm_set_reduce_clean( struct colm_program *prg, unsigned char reduce_clean
 	prg->reduce_clean = reduce_clean;
 }
 
+void colm_set_lazy_locations( struct colm_program *prg, int lazy_locations )
+{
+	prg->lazy_locations = lazy_locations;
+}
+
+void colm_set_no_locations( struct colm_program *prg, int no_locations )
+{
+	prg->no_locations = no_locations;
+}
+
+void colm_set_auto_commit( struct colm_program *prg, long auto_commit )
+{
+	prg->auto_commit = auto_commit;
+}
+
+void colm_set_bt_memo( struct colm_program *prg, int bt_memo )
+{
+	prg->bt_memo = bt_memo;
+}
+
+void colm_set_bt_profile( struct colm_program *prg, const char *file )
+{
+	if ( prg->bt_profile != 0 )
+		colm_bt_profile_free( prg->bt_profile );
+	prg->bt_profile = colm_bt_profile_new( prg, file );
+}
+
+void colm_run_buf_stats( struct colm_program *prg, struct colm_run_buf_stats *stats )
+{
+	stats->allocated = prg->run_buf_pool.allocated;
+	stats->reused = prg->run_buf_pool.reused;
+	stats->released = prg->run_buf_pool.released;
+	stats->pooled = prg->run_buf_pool.pooled;
+	stats->high_water = prg->run_buf_pool.high_water;
+	stats->pinned = prg->run_buf_pool.pinned;
+}
+
+void colm_input_stats( struct colm_program *prg, struct colm_input_stats *stats )
+{
+	stats->seq_bufs = prg->seq_buf_stats.allocated;
+	stats->seq_bufs_live = prg->seq_buf_stats.allocated - prg->seq_buf_stats.released;
+	stats->queue_high_water = prg->seq_buf_stats.queue_high_water;
+	stats->stash_high_water = prg->seq_buf_stats.stash_high_water;
+}
+
+static void add_data_counters( struct colm_input_counters *counters, struct stream_impl *si )
+{
+	struct stream_impl_data *sid = (struct stream_impl_data*)si;
+	if ( sid != 0 && sid->type == 'D' )
+		colm_add_input_counters( counters, &sid->counters );
+}
+
+static void add_seq_counters( struct colm_input_counters *counters, struct seq_buf *buf )
+{
+	/* Sources the input owns are not on the heap. */
+	for ( ; buf != 0; buf = buf->next ) {
+		if ( buf->own_si )
+			add_data_counters( counters, buf->si );
+	}
+}
+
+void colm_input_counters( struct colm_program *prg, struct colm_input_counters *counters )
+{
+	*counters = prg->input_counters;
+
+	struct colm_struct *s;
+	for ( s = prg->heap.head; s != 0; s = s->next ) {
+		if ( s->id == prg->rtd->struct_input_id ) {
+			struct input_impl_seq *si = (struct input_impl_seq*)((input_t*)s)->impl;
+			if ( si != 0 && si->type == 'S' ) {
+				colm_add_input_counters( counters, &si->counters );
+				add_seq_counters( counters, si->queue.head );
+				add_seq_counters( counters, si->stash );
+			}
+		}
+		else if ( s->id == prg->rtd->struct_stream_id ) {
+			add_data_counters( counters, ((stream_t*)s)->impl );
+		}
+	}
+}
+
 program_t *colm_new_program( struct colm_sections *rtd )
 {
 	program_t *prg = malloc(sizeof(program_t));
@@ -192,6 +273,7 @@ program_t *colm_new_program( struct colm_sections *rtd )
 	init_pool_alloc( &prg->parse_tree_pool, sizeof(parse_tree_t) );
 	init_pool_alloc( &prg->head_pool, sizeof(head_t) );
 	init_pool_alloc( &prg->location_pool, sizeof(location_t) );
+	init_pool_alloc( &prg->seq_buf_pool, sizeof(struct seq_buf) );
 
 	prg->true_val = (tree_t*) 1;
 	prg->false_val = (tree_t*) 0;
@@ -283,12 +365,18 @@ int colm_delete_program( program_t *prg )
 
 	colm_tree_downref( prg, sp, prg->error );
 
+	if ( prg->bt_profile != 0 ) {
+		colm_bt_profile_write( prg, prg->bt_profile );
+		colm_bt_profile_free( prg->bt_profile );
+	}
+
 #if DEBUG
 	long kid_lost = kid_num_lost( prg );
 	long tree_lost = tree_num_lost( prg );
 	long parse_tree_lost = parse_tree_num_lost( &prg->parse_tree_pool );
 	long head_lost = head_num_lost( prg );
 	long location_lost = location_num_lost( prg );
+	long seq_buf_lost = seq_buf_num_lost( prg );
 
 	if ( kid_lost )
 		message( "warning: lost kids: %ld\n", kid_lost );
@@ -304,6 +392,9 @@ int colm_delete_program( program_t *prg )
 
 	if ( location_lost )
 		message( "warning: lost locations: %ld\n", location_lost );
+
+	if ( seq_buf_lost )
+		message( "warning: lost seq bufs: %ld\n", seq_buf_lost );
 #endif
 
 	kid_clear( prg );
@@ -311,6 +402,7 @@ int colm_delete_program( program_t *prg )
 	head_clear( prg );
 	parse_tree_clear( &prg->parse_tree_pool );
 	location_clear( prg );
+	seq_buf_clear( prg );
 
 	struct run_buf *rb = prg->alloc_run_buf;
 	while ( rb != 0 ) {
@@ -319,6 +411,24 @@ int colm_delete_program( program_t *prg )
 		rb = next;
 	}
 
+	rb = prg->pinned_run_buf;
+	while ( rb != 0 ) {
+		struct run_buf *next = rb->next;
+		if ( rb->file_mapping != 0 )
+			colm_file_mapping_delete( rb->file_mapping );
+		free( rb );
+		rb = next;
+	}
+
+	colm_run_buf_pool_clear( prg );
+
+	struct line_index *li = prg->line_indexes;
+	while ( li != 0 ) {
+		struct line_index *next = li->next;
+		colm_line_index_delete( li );
+		li = next;
+	}
+
 	vm_clear( prg );
 
 	if ( prg->stream_fns ) {
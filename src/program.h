@@ -147,6 +147,7 @@ struct colm_program
 	struct pool_alloc parse_tree_pool;
 	struct pool_alloc head_pool;
 	struct pool_alloc location_pool;
+	struct pool_alloc seq_buf_pool;
 
 	tree_t *true_val;
 	tree_t *false_val;
@@ -159,8 +160,38 @@ struct colm_program
 
 	tree_t *error;
 
+	/* Consume buffers of finished parsers. Token data points into them. */
 	struct run_buf *alloc_run_buf;
 
+	struct run_buf_pool run_buf_pool;
+
+	struct seq_buf_stats seq_buf_stats;
+
+	/* Counters of inputs and streams that have been destroyed. */
+	struct colm_input_counters input_counters;
+
+	/* Input buffers that left their streams while tokens point into them. */
+	struct run_buf *pinned_run_buf;
+
+	/* Input taken by a parser between automatic commits. */
+	long auto_commit;
+
+	/* Parsers remember failed alternatives. Pushes and pulls by programs
+	 * are counted because they move remembered input positions. */
+	int bt_memo;
+	long input_changes;
+
+	/* Set when backtracking is profiled. Written out on delete. */
+	struct bt_profile *bt_profile;
+
+	/* Resolve locations on demand from newline indexes. */
+	int lazy_locations;
+
+	/* Parsers default to keeping no locations and streams track only the
+	 * byte offset. */
+	int no_locations;
+	struct line_index *line_indexes;
+
 	/* Current stack block limits. Changed when crossing block boundaries. */
 	tree_t **sb_beg;
 	tree_t **sb_end;
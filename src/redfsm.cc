@@ -32,6 +32,7 @@
 
 #include "fsmgraph.h"
 #include "parsetree.h"
+#include "compiler.h"
 
 using std::ostringstream;
 
@@ -59,6 +60,9 @@ RedFsm::RedFsm()
 	allActions(0),
 	allActionTables(0),
 	allStates(0),
+	charClass(0),
+	classKey(0),
+	numCharClasses(0),
 	bAnyToStateActions(false),
 	bAnyFromStateActions(false),
 	bAnyRegActions(false),
@@ -135,6 +139,40 @@ void RedFsm::depthFirstOrdering()
 	assert( stateListLen == stateList.length() );
 }
 
+struct CmpStateByVisits
+{
+	static int compare( RedState *st1, RedState *st2 )
+	{
+		if ( st1->visits > st2->visits )
+			return -1;
+		else if ( st1->visits < st2->visits )
+			return 1;
+		else
+			return 0;
+	}
+};
+
+/* Put the most visited states first so the hot part of the scanner sits
+ * together. Ties keep the depth first order. Ids are left alone. */
+void RedFsm::hotStateOrdering()
+{
+	depthFirstOrdering();
+
+	int pos = 0;
+	RedState **ptrList = new RedState*[stateList.length()];
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ )
+		ptrList[pos++] = st;
+
+	MergeSort<RedState*, CmpStateByVisits> mergeSort;
+	mergeSort.sort( ptrList, stateList.length() );
+
+	stateList.abandon();
+	for ( int st = 0; st < pos; st++ )
+		stateList.append( ptrList[st] );
+
+	delete[] ptrList;
+}
+
 /* Assign state ids by appearance in the state list. */
 void RedFsm::sequentialStateIds()
 {
@@ -303,23 +341,39 @@ void RedFsm::chooseSingle()
 	}
 }
 
+/* Expands the singles and ranges of each state into a dense list covering
+ * lowKey to highKey. Can be called after choosing singles and defaults. */
 void RedFsm::makeFlat()
 {
 	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
 		st->condLowKey = 0;
 		st->condHighKey = 0;
 
-		if ( st->outRange.length() == 0 ) {
+		if ( st->outSingle.length() == 0 && st->outRange.length() == 0 ) {
 			st->lowKey = st->highKey = 0;
 			st->transList = 0;
 		}
 		else {
-			st->lowKey = st->outRange[0].lowKey;
-			st->highKey = st->outRange[st->outRange.length()-1].highKey;
+			/* Both lists are sorted, the bounds come from the ends. */
+			bool first = true;
+			if ( st->outSingle.length() > 0 ) {
+				st->lowKey = st->outSingle[0].lowKey;
+				st->highKey = st->outSingle[st->outSingle.length()-1].highKey;
+				first = false;
+			}
+			if ( st->outRange.length() > 0 ) {
+				Key low = st->outRange[0].lowKey;
+				Key high = st->outRange[st->outRange.length()-1].highKey;
+				if ( first || low < st->lowKey )
+					st->lowKey = low;
+				if ( first || high > st->highKey )
+					st->highKey = high;
+			}
+
 			unsigned long long span = keyOps->span( st->lowKey, st->highKey );
 			st->transList = new RedTrans*[ span ];
 			memset( st->transList, 0, sizeof(RedTrans*)*span );
-			
+
 			for ( RedTransList::Iter trans = st->outRange; trans.lte(); trans++ ) {
 				unsigned long long base, trSpan;
 				base = keyOps->span( st->lowKey, trans->lowKey )-1;
@@ -328,6 +382,13 @@ void RedFsm::makeFlat()
 					st->transList[base+pos] = trans->value;
 			}
 
+			/* Ranges may have been extended over singles, which take
+			 * precedence. */
+			for ( RedTransList::Iter trans = st->outSingle; trans.lte(); trans++ ) {
+				unsigned long long base = keyOps->span( st->lowKey, trans->lowKey )-1;
+				st->transList[base] = trans->value;
+			}
+
 			/* Fill in the gaps with the default transition. */
 			for ( unsigned long long pos = 0; pos < span; pos++ ) {
 				if ( st->transList[pos] == 0 )
@@ -337,6 +398,108 @@ void RedFsm::makeFlat()
 	}
 }
 
+RedTrans *RedFsm::keyTrans( RedState *state, Key key )
+{
+	if ( state->transList != 0 && state->lowKey <= key && key <= state->highKey )
+		return state->transList[keyOps->span( state->lowKey, key ) - 1];
+	return state->defTrans;
+}
+
+/* Starting with every byte in one class, split the classes by the
+ * transitions of each state in turn. Two bytes end up in the same class only
+ * if every state takes the same transition on them. Requires the flat
+ * expansion. */
+void RedFsm::makeCharClasses()
+{
+	/* Only byte alphabets are compressed. */
+	if ( keyOps->alphSize() != 256 )
+		return;
+
+	charClass = new unsigned char[256];
+	memset( charClass, 0, sizeof(unsigned char) * 256 );
+	numCharClasses = 1;
+
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		/* Keyed by the old class in the high bits, transition in the low. */
+		BstMap<long long, int> split;
+		for ( int b = 0; b < 256; b++ ) {
+			RedTrans *trans = keyTrans( st, Key( (long)(char)b ) );
+			long long key = ( (long long)charClass[b] << 32 ) |
+					( trans != 0 ? trans->id + 1 : 0 );
+
+			/* New pairs get the next class id, existing pairs their own. */
+			BstMapEl<long long, int> *inMap = 0;
+			split.insert( key, split.length(), &inMap );
+			charClass[b] = inMap->value;
+		}
+		numCharClasses = split.length();
+	}
+
+	classKey = new Key[numCharClasses];
+	for ( int b = 255; b >= 0; b-- )
+		classKey[charClass[b]] = Key( (long)(char)b );
+}
+
+/* A state that transitions back to itself with no action can pass over a run
+ * of such bytes without visiting the state again. Only the widest
+ * MAX_LOOP_RANGES ranges are kept. Leaving bytes out just stops the skip
+ * early. */
+void RedFsm::findSelfLoops()
+{
+	loopRanges.empty();
+	loopRanges.append( 0 );
+
+	/* Only byte alphabets. */
+	if ( keyOps->alphSize() != 256 )
+		return;
+
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		st->loopOffset = 0;
+		if ( st == errState || st->toStateAction != 0 || st->fromStateAction != 0 )
+			continue;
+
+		int low[MAX_LOOP_RANGES], high[MAX_LOOP_RANGES], n = 0;
+		int b = 0;
+		while ( b < 256 ) {
+			int lb = b;
+			while ( b < 256 ) {
+				RedTrans *trans = keyTrans( st, Key( (long)(char)b ) );
+				if ( trans == 0 || trans->targ != st || trans->action != 0 )
+					break;
+				b += 1;
+			}
+
+			if ( b == lb ) {
+				b += 1;
+				continue;
+			}
+
+			if ( n < MAX_LOOP_RANGES ) {
+				low[n] = lb, high[n] = b - 1;
+				n += 1;
+			}
+			else {
+				/* Replace the narrowest if this one is wider. */
+				int nr = 0;
+				for ( int i = 1; i < n; i++ ) {
+					if ( high[i] - low[i] < high[nr] - low[nr] )
+						nr = i;
+				}
+				if ( b - 1 - lb > high[nr] - low[nr] )
+					low[nr] = lb, high[nr] = b - 1;
+			}
+		}
+
+		if ( n > 0 ) {
+			st->loopOffset = loopRanges.length();
+			loopRanges.append( n );
+			for ( int i = 0; i < n; i++ ) {
+				loopRanges.append( low[i] );
+				loopRanges.append( high[i] );
+			}
+		}
+	}
+}
 
 /* A default transition has been picked, move it from the outRange to the
  * default pointer. */
@@ -1007,6 +1170,90 @@ fsm_tables *RedFsm::makeFsmTables()
 		fsmTables->eof_targs[pos++] = targ;
 	}
 
+	/*
+	 * Flat layout, indexed by character class.
+	 */
+	makeFlat();
+	makeCharClasses();
+
+	fsmTables->char_class = charClass;
+	fsmTables->num_char_classes = numCharClasses;
+
+	fsmTables->flat_keys = 0;
+	fsmTables->flat_key_spans = 0;
+	fsmTables->flat_index_offsets = 0;
+	fsmTables->flat_indicies = 0;
+	fsmTables->flat_trans_targs = 0;
+	fsmTables->flat_trans_actions = 0;
+	fsmTables->num_flat_indicies = 0;
+	fsmTables->num_flat_trans = 0;
+
+	if ( charClass != 0 ) {
+		/* Rows cover only the classes that don't take the default. */
+		pos = 0;
+		fsmTables->flat_keys = new unsigned char[2 * fsmTables->num_states];
+		fsmTables->flat_key_spans = new long[fsmTables->num_states];
+		for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+			int low = -1, high = -1;
+			for ( int c = 0; c < numCharClasses; c++ ) {
+				if ( keyTrans( st, classKey[c] ) != st->defTrans ) {
+					if ( low < 0 )
+						low = c;
+					high = c;
+				}
+			}
+
+			fsmTables->flat_keys[pos*2] = low < 0 ? 0 : low;
+			fsmTables->flat_keys[pos*2+1] = low < 0 ? 0 : high;
+			fsmTables->flat_key_spans[pos++] = low < 0 ? 0 : high - low + 1;
+		}
+
+		/* One extra slot per state for classes that fall outside the span. */
+		pos = 0, curIndOffset = 0;
+		fsmTables->flat_index_offsets = new long[fsmTables->num_states];
+		for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+			fsmTables->flat_index_offsets[pos] = curIndOffset;
+			curIndOffset += fsmTables->flat_key_spans[pos++] + 1;
+		}
+
+		pos = 0;
+		fsmTables->num_flat_indicies = curIndOffset;
+		fsmTables->flat_indicies = new long[fsmTables->num_flat_indicies];
+		for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+			long low = fsmTables->flat_keys[st->id*2];
+			long span = fsmTables->flat_key_spans[st->id];
+			for ( long c = 0; c < span; c++ )
+				fsmTables->flat_indicies[pos++] = keyTrans( st, classKey[low+c] )->id;
+
+			/* The machine is complete, only the error state goes without a
+			 * default. It is never scanned from. */
+			fsmTables->flat_indicies[pos++] = st->defTrans != 0 ?
+					st->defTrans->id : getErrorTrans()->id;
+		}
+
+		fsmTables->num_flat_trans = transSet.length();
+		fsmTables->flat_trans_targs = new long[fsmTables->num_flat_trans];
+		fsmTables->flat_trans_actions = new long[fsmTables->num_flat_trans];
+		for ( RedTransSet::Iter trans = transSet; trans.lte(); trans++ ) {
+			fsmTables->flat_trans_targs[trans->id] = trans->targ->id;
+			fsmTables->flat_trans_actions[trans->id] = transAction( trans );
+		}
+	}
+
+	/*
+	 * Self loops.
+	 */
+	findSelfLoops();
+
+	fsmTables->loop_offsets = new long[fsmTables->num_states];
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ )
+		fsmTables->loop_offsets[st->id] = st->loopOffset;
+
+	fsmTables->num_loop_ranges = loopRanges.length();
+	fsmTables->loop_ranges = new unsigned char[fsmTables->num_loop_ranges];
+	memcpy( fsmTables->loop_ranges, loopRanges.data,
+			sizeof(unsigned char) * fsmTables->num_loop_ranges );
+
 	/* Start state. */
 	fsmTables->start_state = startState->id;
 
@@ -1024,6 +1271,95 @@ fsm_tables *RedFsm::makeFsmTables()
 	fsmTables->action_switch = new GenAction*[fsmTables->num_action_switch];
 	for ( GenActionList::Iter act = genActionList; act.lte(); act++ )
 		fsmTables->action_switch[pos++] = act;
+
+	/*
+	 * Action code. Each inline list is lowered once so the interpreted
+	 * scanner does not walk it.
+	 */
+	Vector<long> actionCode;
+	Vector<long> lmSwitchTokens;
+
+	pos = 0;
+	fsmTables->action_code_offsets = new long[fsmTables->num_action_switch];
+	for ( GenActionList::Iter act = genActionList; act.lte(); act++ ) {
+		fsmTables->action_code_offsets[pos++] = actionCode.length();
+
+		for ( InlineList::Iter item = *act->inlineList; item.lte(); item++ ) {
+			switch ( item->type ) {
+			case InlineItem::Text:
+			case InlineItem::LmInitTokStart:
+				assert(false);
+				break;
+			case InlineItem::LmSetActId:
+				actionCode.append( FSM_OP_SET_ACT_ID );
+				actionCode.append( item->longestMatchPart->longestMatchId );
+				break;
+			case InlineItem::LmSetTokEnd:
+				actionCode.append( FSM_OP_SET_TOKEND );
+				break;
+			case InlineItem::LmInitAct:
+				actionCode.append( FSM_OP_INIT_ACT );
+				break;
+			case InlineItem::LmSetTokStart:
+				actionCode.append( FSM_OP_SET_TOKSTART );
+				break;
+			case InlineItem::LmSwitch: {
+				/* Table from act id to token. */
+				long length = 0;
+				TokenInstanceListReg &list = item->tokenRegion->tokenInstanceList;
+				for ( TokenInstanceListReg::Iter lmi = list; lmi.lte(); lmi++ ) {
+					if ( lmi->inLmSelect && lmi->longestMatchId >= length )
+						length = lmi->longestMatchId + 1;
+				}
+
+				long offset = lmSwitchTokens.length();
+				for ( long i = 0; i < length; i++ )
+					lmSwitchTokens.append( -1 );
+				for ( TokenInstanceListReg::Iter lmi = list; lmi.lte(); lmi++ ) {
+					if ( lmi->inLmSelect ) {
+						lmSwitchTokens[offset + lmi->longestMatchId] =
+								lmi->tokenDef->tdLangEl->id;
+					}
+				}
+
+				actionCode.append( FSM_OP_LM_SWITCH );
+				actionCode.append( offset );
+				actionCode.append( length );
+				actionCode.append( item->tokenRegion->lmSwitchHandlesError );
+				break;
+			}
+			case InlineItem::LmOnLast:
+				actionCode.append( FSM_OP_ON_LAST );
+				actionCode.append( item->longestMatchPart->tokenDef->tdLangEl->id );
+				break;
+			case InlineItem::LmOnNext:
+				actionCode.append( FSM_OP_ON_NEXT );
+				actionCode.append( item->longestMatchPart->tokenDef->tdLangEl->id );
+				break;
+			case InlineItem::LmOnLagBehind:
+				actionCode.append( FSM_OP_ON_LAG_BEHIND );
+				actionCode.append( item->longestMatchPart->tokenDef->tdLangEl->id );
+				break;
+			}
+		}
+
+		if ( act->markType == MarkMark ) {
+			actionCode.append( FSM_OP_MARK );
+			actionCode.append( act->markId - 1 );
+		}
+
+		actionCode.append( FSM_OP_END );
+	}
+
+	fsmTables->num_action_code = actionCode.length();
+	fsmTables->action_code = new long[fsmTables->num_action_code];
+	memcpy( fsmTables->action_code, actionCode.data,
+			sizeof(long) * fsmTables->num_action_code );
+
+	fsmTables->num_lm_switch_tokens = lmSwitchTokens.length();
+	fsmTables->lm_switch_tokens = new long[fsmTables->num_lm_switch_tokens];
+	memcpy( fsmTables->lm_switch_tokens, lmSwitchTokens.data,
+			sizeof(long) * fsmTables->num_lm_switch_tokens );
 	
 	/*
 	 * entryByRegion
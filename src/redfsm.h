@@ -274,7 +274,9 @@ struct RedState
 		bAnyRegCurStateRef(false),
 		partitionBoundary(false),
 		inTrans(0),
-		numInTrans(0)
+		numInTrans(0),
+		loopOffset(0),
+		visits(0)
 	{ }
 
 	/* Transitions out. */
@@ -313,6 +315,13 @@ struct RedState
 
 	RedTrans **inTrans;
 	int numInTrans;
+
+	/* Offset of the byte ranges the state loops on without actions. Zero if
+	 * there are none. */
+	long loopOffset;
+
+	/* Times the scanner entered the state, from a profile. */
+	unsigned long visits;
 };
 
 /* List of states. */
@@ -355,6 +364,16 @@ struct RedFsm
 	RedEntryMap redEntryMap;
 	RegionToEntry regionToEntry;
 
+	/* Alphabet compression. Each byte maps to a class of keys that no state
+	 * distinguishes. The class key is a representative member. */
+	unsigned char *charClass;
+	Key *classKey;
+	int numCharClasses;
+
+	/* Byte ranges of self loops. Each list is a count followed by low/high
+	 * pairs. The empty list is at offset zero. */
+	Vector<unsigned char> loopRanges;
+
 	bool bAnyToStateActions;
 	bool bAnyFromStateActions;
 	bool bAnyRegActions;
@@ -415,6 +434,15 @@ struct RedFsm
 
 	void makeFlat();
 
+	/* Transition taken on a key, using the flat expansion. */
+	RedTrans *keyTrans( RedState *state, Key key );
+
+	/* Partition the byte alphabet into character classes. */
+	void makeCharClasses();
+
+	/* Find the states that can skip ahead over bytes they loop on. */
+	void findSelfLoops();
+
 	/* Move a selected transition from ranges to default. */
 	void moveToDefault( RedTrans *defTrans, RedState *state );
 
@@ -438,6 +466,9 @@ struct RedFsm
 	void depthFirstOrdering( RedState *state );
 	void depthFirstOrdering();
 
+	/* Ordering states by profiled visits, most visited first. */
+	void hotStateOrdering();
+
 	/* Set state ids. */
 	void sequentialStateIds();
 	void sortStateIdsByFinal();
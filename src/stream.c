@@ -21,13 +21,27 @@
  */
 
 #include <colm/input.h>
+#include <colm/config.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(HAVE_SYS_UIO_H)
+#include <sys/uio.h>
+#endif
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#include <poll.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 
 #include <colm/pdarun.h>
 #include <colm/debug.h>
@@ -41,34 +55,50 @@ DEF_STREAM_FUNCS( stream_funcs_data, stream_impl_data );
 
 extern struct stream_funcs_data file_funcs;
 extern struct stream_funcs_data accum_funcs;
+extern struct stream_funcs_data mmap_funcs;
 
 void stream_impl_push_line( struct stream_impl_data *ss, int ll )
 {
 	if ( ss->line_len == 0 ) {
-		ss->lines_cur = 0;
+		ss->lines_avail = 0;
 		ss->lines_alloc = 16;
 		ss->line_len = malloc( sizeof(int) * ss->lines_alloc );
 	}
-	else if ( ss->lines_cur == ss->lines_alloc ) {
-		int lines_alloc_new = ss->lines_alloc * 2;
-		int *line_len_new = malloc( sizeof(int) * lines_alloc_new );
-		memcpy( line_len_new, ss->line_len, sizeof(int) * ss->lines_alloc );
-		ss->lines_alloc = lines_alloc_new;
-		ss->line_len = line_len_new;
+	else if ( ss->lines_avail == ss->lines_alloc ) {
+		ss->lines_alloc *= 2;
+		ss->line_len = realloc( ss->line_len, sizeof(int) * ss->lines_alloc );
 	}
 
-	ss->line_len[ ss->lines_cur ] = ll;
-	ss->lines_cur += 1;
+	ss->line_len[ ss->lines_avail ] = ll;
+	ss->lines_avail += 1;
 }
 
+/* Commits keep the lines of any text that can still be sent back, so the
+ * history does not run out. */
 int stream_impl_pop_line( struct stream_impl_data *ss )
 {
-	int len = 0;
-	if ( ss->lines_cur > 0 ) {
-		ss->lines_cur -= 1;
-		len = ss->line_len[ss->lines_cur];
+	assert( ss->lines_avail > 0 );
+	ss->lines_avail -= 1;
+	return ss->line_len[ss->lines_avail];
+}
+
+/* Only the last keep bytes consumed can be sent back. Drop the lengths of
+ * lines that end before them. */
+static void stream_impl_trim_lines( struct stream_impl_data *ss, long keep )
+{
+	/* Distance back to the newest newline, then to each one before it. */
+	long dist = ss->column;
+	int n = ss->lines_avail;
+	while ( n > 0 && dist <= keep ) {
+		n -= 1;
+		dist += ss->line_len[n];
+	}
+
+	if ( n > 0 ) {
+		memmove( ss->line_len, ss->line_len + n,
+				sizeof(int) * ( ss->lines_avail - n ) );
+		ss->lines_avail -= n;
 	}
-	return len;
 }
 
 static void dump_contents( struct colm_program *prg, struct stream_impl_data *sid )
@@ -86,7 +116,84 @@ static void dump_contents( struct colm_program *prg, struct stream_impl_data *si
 
 static bool loc_set( location_t *loc )
 {
-	return loc->line != 0;
+	return loc->line != 0 || loc->line_index != 0;
+}
+
+static struct line_index *line_index_new( struct colm_program *prg )
+{
+	struct line_index *li = (struct line_index*) malloc( sizeof(struct line_index) );
+	memset( li, 0, sizeof(struct line_index) );
+	li->next = prg->line_indexes;
+	prg->line_indexes = li;
+	return li;
+}
+
+void colm_line_index_delete( struct line_index *li )
+{
+	long c;
+	for ( c = 0; c < li->num_chunks; c++ )
+		free( li->chunks[c] );
+	free( li->chunks );
+	free( li );
+}
+
+static long line_index_get( struct line_index *li, long i )
+{
+	return li->chunks[i / LINE_INDEX_CHUNK][i % LINE_INDEX_CHUNK];
+}
+
+static void line_index_push( struct line_index *li, long offset )
+{
+	if ( li->length < li->filled && line_index_get( li, li->length ) == offset ) {
+		/* Consuming again what was sent back. */
+		li->length += 1;
+		return;
+	}
+
+	long c = li->length / LINE_INDEX_CHUNK;
+	if ( c == li->num_chunks ) {
+		li->chunks = (long**) realloc( li->chunks, sizeof(long*) * ( c + 1 ) );
+		li->chunks[c] = (long*) malloc( sizeof(long) * LINE_INDEX_CHUNK );
+		li->num_chunks += 1;
+	}
+
+	li->chunks[c][li->length % LINE_INDEX_CHUNK] = offset;
+	li->length += 1;
+	li->filled = li->length;
+}
+
+/* Drop sent back entries that the text consumed up to byte disagrees with. */
+static void line_index_settle( struct line_index *li, long byte )
+{
+	if ( li->length < li->filled && line_index_get( li, li->length ) < byte )
+		li->filled = li->length;
+}
+
+/* Number of newlines recorded before byte. */
+static long line_index_count( struct line_index *li, long byte )
+{
+	long low = 0, high = li->filled;
+	while ( low < high ) {
+		long mid = low + ( high - low ) / 2;
+		if ( line_index_get( li, mid ) < byte )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/* Fill in line and column of a location that only has its byte offset. */
+void colm_location_resolve( location_t *loc )
+{
+	if ( loc != 0 && loc->line_index != 0 ) {
+		long n = line_index_count( loc->line_index, loc->byte );
+		loc->line = n + 1;
+		loc->column = n > 0 ?
+				loc->byte - line_index_get( loc->line_index, n - 1 ) :
+				loc->byte + 1;
+		loc->line_index = 0;
+	}
 }
 
 static void close_stream_file( FILE *file )
@@ -114,6 +221,9 @@ static void si_data_push_tail( struct stream_impl_data *ss, struct run_buf *run_
 
 static struct run_buf *si_data_pop_tail( struct stream_impl_data *ss )
 {
+	if ( ss->scan_buf == ss->queue.tail )
+		ss->scan_buf = 0;
+
 	struct run_buf *ret = ss->queue.tail;
 	ss->queue.tail = ss->queue.tail->prev;
 	if ( ss->queue.tail == 0 )
@@ -126,6 +236,8 @@ static struct run_buf *si_data_pop_tail( struct stream_impl_data *ss )
 
 static void si_data_push_head( struct stream_impl_data *ss, struct run_buf *run_buf )
 {
+	ss->scan_buf = 0;
+
 	if ( ss->queue.head == 0 ) {
 		run_buf->prev = run_buf->next = 0;
 		ss->queue.head = ss->queue.tail = run_buf;
@@ -140,6 +252,8 @@ static void si_data_push_head( struct stream_impl_data *ss, struct run_buf *run_
 
 static struct run_buf *si_data_pop_head( struct stream_impl_data *ss )
 {
+	ss->scan_buf = 0;
+
 	struct run_buf *ret = ss->queue.head;
 	ss->queue.head = ss->queue.head->next;
 	if ( ss->queue.head == 0 )
@@ -150,36 +264,135 @@ static struct run_buf *si_data_pop_head( struct stream_impl_data *ss )
 }
 
 
-struct run_buf *new_run_buf( int sz )
+/* Sizes are rounded up to a power of two times FSM_BUFSIZE so buffers can be
+ * reused for any request in their class. */
+struct run_buf *new_run_buf( struct colm_program *prg, int sz )
 {
+	struct run_buf_pool *pool = &prg->run_buf_pool;
+	long size = FSM_BUFSIZE;
+	int c = 0;
+	while ( size < sz ) {
+		size *= 2;
+		c += 1;
+	}
+
 	struct run_buf *rb;
-	if ( sz > FSM_BUFSIZE ) {
-		int ssz = sizeof(struct run_buf) + sz - FSM_BUFSIZE;
-		rb = (struct run_buf*) malloc( ssz );
-		memset( rb, 0, ssz );
+	if ( c < RUN_BUF_CLASSES && pool->free[c] != 0 ) {
+		rb = pool->free[c];
+		pool->free[c] = rb->next;
+		pool->pooled -= size;
+		pool->reused += 1;
 	}
 	else {
-		rb = (struct run_buf*) malloc( sizeof(struct run_buf) );
-		memset( rb, 0, sizeof(struct run_buf) );
+		rb = (struct run_buf*) malloc( sizeof(struct run_buf) + size - FSM_BUFSIZE );
+		pool->allocated += 1;
 	}
+
+	rb->length = 0;
+	rb->offset = 0;
+	rb->next = rb->prev = 0;
+	rb->size = size;
+	rb->refs = 0;
+	rb->retired = 0;
+	rb->file_mapping = 0;
 	return rb;
 }
 
-/* Keep the position up to date after consuming text. */
-void update_position_data( struct stream_impl_data *is, const char *data, long length )
+void free_run_buf( struct colm_program *prg, struct run_buf *rb )
 {
-	int i;
-	for ( i = 0; i < length; i++ ) {
-		if ( data[i] == '\n' ) {
-			stream_impl_push_line( is, is->column );
-			is->line += 1;
-			is->column = 1;
+	struct run_buf_pool *pool = &prg->run_buf_pool;
+
+	/* Tokens still point into it. The last one to go frees it. */
+	if ( rb->refs > 0 ) {
+		rb->retired = 1;
+		rb->prev = 0;
+		rb->next = prg->pinned_run_buf;
+		if ( prg->pinned_run_buf != 0 )
+			prg->pinned_run_buf->prev = rb;
+		prg->pinned_run_buf = rb;
+		pool->pinned += 1;
+		return;
+	}
+
+	if ( rb->file_mapping != 0 ) {
+		colm_file_mapping_delete( rb->file_mapping );
+		rb->file_mapping = 0;
+	}
+
+	int c = 0;
+	while ( ( FSM_BUFSIZE << c ) < rb->size )
+		c += 1;
+
+	if ( c < RUN_BUF_CLASSES && pool->pooled + rb->size <= RUN_BUF_POOL_MAX ) {
+		rb->next = pool->free[c];
+		pool->free[c] = rb;
+		pool->pooled += rb->size;
+		if ( pool->pooled > pool->high_water )
+			pool->high_water = pool->pooled;
+	}
+	else {
+		free( rb );
+		pool->released += 1;
+	}
+}
+
+void colm_run_buf_unpin( struct colm_program *prg, struct run_buf *rb )
+{
+	rb->refs -= 1;
+	if ( rb->refs == 0 && rb->retired ) {
+		if ( rb->prev != 0 )
+			rb->prev->next = rb->next;
+		else
+			prg->pinned_run_buf = rb->next;
+		if ( rb->next != 0 )
+			rb->next->prev = rb->prev;
+
+		rb->retired = 0;
+		prg->run_buf_pool.pinned -= 1;
+		free_run_buf( prg, rb );
+	}
+}
+
+void colm_run_buf_pool_clear( struct colm_program *prg )
+{
+	struct run_buf_pool *pool = &prg->run_buf_pool;
+	int c;
+	for ( c = 0; c < RUN_BUF_CLASSES; c++ ) {
+		struct run_buf *rb = pool->free[c];
+		while ( rb != 0 ) {
+			struct run_buf *next = rb->next;
+			free( rb );
+			rb = next;
 		}
-		else {
-			is->column += 1;
+		pool->free[c] = 0;
+	}
+	pool->pooled = 0;
+}
+
+/* Keep the position up to date after consuming text. Jumps between newlines
+ * with memchr, which is vectorized in the C library. */
+void update_position_data( struct stream_impl_data *is, const char *data, long length )
+{
+	const char *p = data, *pe = data + length, *nl;
+	if ( is->line_index != 0 ) {
+		while ( p < pe && ( nl = memchr( p, '\n', pe - p ) ) != 0 ) {
+			line_index_push( is->line_index, is->byte + ( nl - data ) );
+			p = nl + 1;
 		}
+		is->byte += length;
+		line_index_settle( is->line_index, is->byte );
+		return;
 	}
 
+	while ( p < pe && ( nl = memchr( p, '\n', pe - p ) ) != 0 ) {
+		is->column += nl - p;
+		stream_impl_push_line( is, is->column );
+		is->line += 1;
+		is->column = 1;
+		p = nl + 1;
+	}
+
+	is->column += pe - p;
 	is->byte += length;
 }
 
@@ -188,17 +401,20 @@ void undo_position_data( struct stream_impl_data *is, const char *data, long len
 {
 	/* FIXME: this needs to fetch the position information from the parsed
 	 * token and restore based on that.. */
-	int i;
-	for ( i = 0; i < length; i++ ) {
-		if ( data[i] == '\n' ) {
-			is->line -= 1;
-			is->column = stream_impl_pop_line( is );
-		}
-		else {
-			is->column -= 1;
-		}
+	const char *p = data, *pe = data + length, *nl;
+	if ( is->line_index != 0 ) {
+		is->byte -= length;
+		is->line_index->length = line_index_count( is->line_index, is->byte );
+		return;
+	}
+
+	while ( p < pe && ( nl = memchr( p, '\n', pe - p ) ) != 0 ) {
+		is->line -= 1;
+		is->column = stream_impl_pop_line( is );
+		p = nl + 1;
 	}
 
+	is->column -= pe - p;
 	is->byte -= length;
 }
 
@@ -207,38 +423,306 @@ void undo_position_data( struct stream_impl_data *is, const char *data, long len
  * Interface
  */
 
+static void start_line_index( struct colm_program *prg, struct stream_impl_data *sid )
+{
+	/* Can only start a newline index before anything is consumed. */
+	if ( prg->lazy_locations && !prg->no_locations &&
+			sid->line_index == 0 && sid->byte == 0 )
+		sid->line_index = line_index_new( prg );
+}
+
+static void consume_position( struct colm_program *prg,
+		struct stream_impl_data *sid, const char *data, int length )
+{
+	if ( prg->no_locations )
+		sid->byte += length;
+	else
+		update_position_data( sid, data, length );
+}
+
+static void undo_consume_position( struct colm_program *prg,
+		struct stream_impl_data *sid, const char *data, int length )
+{
+	if ( prg->no_locations )
+		sid->byte -= length;
+	else
+		undo_position_data( sid, data, length );
+}
+
 static void data_transfer_loc( struct colm_program *prg, location_t *loc, struct stream_impl_data *ss )
 {
 	loc->name = ss->name;
-	loc->line = ss->line;
-	loc->column = ss->column;
 	loc->byte = ss->byte;
+	if ( ss->line_index != 0 )
+		loc->line_index = ss->line_index;
+	else {
+		loc->line = ss->line;
+		loc->column = ss->column;
+	}
 }
 
 /*
  * Data inputs: files, strings, etc.
  */
 
+/*
+ * Read-ahead for file and fd streams. A helper thread reads the descriptor
+ * into a ring of run_bufs while the parser works, so the parser only waits
+ * when the ring is empty. The thread polls the descriptor and a wake pipe,
+ * and reads with read(2) only once the descriptor is ready, so stopping it
+ * never loses input. Because it bypasses the FILE, read-ahead can only start
+ * before the stream has read anything through it.
+ */
+
+#if defined(HAVE_PTHREAD_H)
+
+#define READ_AHEAD_BLOCK ( 8 * FSM_BUFSIZE )
+
+struct read_ahead
+{
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	int fd;
+	int block;
+
+	/* Written to by a stop, to wake the thread waiting for input. */
+	int wake[2];
+
+	struct run_buf **ring;
+	int ring_size;
+	int head;
+	int count;
+
+	/* A block read after the stop was asked for. */
+	struct run_buf *last;
+
+	int eof;
+	int stop;
+};
+
+static void *read_ahead_thread( void *arg )
+{
+	struct read_ahead *ra = (struct read_ahead*)arg;
+
+	while ( true ) {
+		/* Not from the program's pool, which is not locked. */
+		long size = ra->block > FSM_BUFSIZE ? ra->block : FSM_BUFSIZE;
+		struct run_buf *rb = (struct run_buf*) malloc( sizeof(struct run_buf) + size - FSM_BUFSIZE );
+		memset( rb, 0, sizeof(struct run_buf) );
+		rb->size = size;
+
+		struct pollfd fds[2];
+		fds[0].fd = ra->fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = ra->wake[0];
+		fds[1].events = POLLIN;
+
+		int ready;
+		do {
+			ready = poll( fds, 2, -1 );
+		}
+		while ( ready < 0 && errno == EINTR );
+
+		/* Woken by a stop, the input is left to the FILE. */
+		ssize_t received = 0;
+		if ( ready > 0 && fds[1].revents == 0 ) {
+			do {
+				received = read( ra->fd, rb->data, ra->block );
+			}
+			while ( received < 0 && errno == EINTR );
+		}
+
+		pthread_mutex_lock( &ra->mutex );
+
+		while ( received > 0 && ra->count == ra->ring_size && !ra->stop )
+			pthread_cond_wait( &ra->cond, &ra->mutex );
+
+		if ( received <= 0 || ra->stop ) {
+			if ( received > 0 ) {
+				rb->length = received;
+				ra->last = rb;
+			}
+			else {
+				free( rb );
+			}
+			ra->eof = 1;
+			pthread_cond_broadcast( &ra->cond );
+			pthread_mutex_unlock( &ra->mutex );
+			break;
+		}
+
+		rb->length = received;
+		ra->ring[( ra->head + ra->count ) % ra->ring_size] = rb;
+		ra->count += 1;
+		pthread_cond_broadcast( &ra->cond );
+		pthread_mutex_unlock( &ra->mutex );
+	}
+
+	return 0;
+}
+
+static void read_ahead_start( struct stream_impl_data *ss, int ring_size )
+{
+	/* Anything already buffered in the FILE would be skipped. */
+	if ( ss->read_ahead != 0 || ss->file == 0 || ss->byte != 0 || ss->queue.head != 0 )
+		return;
+
+	struct read_ahead *ra = (struct read_ahead*) malloc( sizeof(struct read_ahead) );
+	memset( ra, 0, sizeof(struct read_ahead) );
+	pthread_mutex_init( &ra->mutex, 0 );
+	pthread_cond_init( &ra->cond, 0 );
+	ra->fd = fileno( ss->file );
+	ra->block = ss->block_size > 0 ? ss->block_size : READ_AHEAD_BLOCK;
+	ra->ring_size = ring_size;
+	ra->ring = (struct run_buf**) malloc( sizeof(struct run_buf*) * ring_size );
+
+	if ( pipe( ra->wake ) != 0 ) {
+		pthread_cond_destroy( &ra->cond );
+		pthread_mutex_destroy( &ra->mutex );
+		free( ra->ring );
+		free( ra );
+		return;
+	}
+
+	if ( pthread_create( &ra->thread, 0, &read_ahead_thread, ra ) != 0 ) {
+		close( ra->wake[0] );
+		close( ra->wake[1] );
+		pthread_cond_destroy( &ra->cond );
+		pthread_mutex_destroy( &ra->mutex );
+		free( ra->ring );
+		free( ra );
+		return;
+	}
+
+	ss->read_ahead = ra;
+}
+
+/* Queue a block the thread has read. */
+static void read_ahead_push( struct stream_impl_data *ss, struct run_buf *rb )
+{
+	ss->counters.reads += 1;
+	ss->counters.bytes_read += rb->length;
+	ss->counters.run_bufs += 1;
+	si_data_push_tail( ss, rb );
+}
+
+/* Stops the thread. What it has read goes onto the queue, ahead of anything
+ * the stream reads through its FILE from here on. */
+static void read_ahead_stop( struct colm_program *prg, struct stream_impl_data *ss )
+{
+	struct read_ahead *ra = ss->read_ahead;
+	if ( ra == 0 )
+		return;
+
+	pthread_mutex_lock( &ra->mutex );
+	ra->stop = 1;
+	pthread_cond_broadcast( &ra->cond );
+	pthread_mutex_unlock( &ra->mutex );
+
+	char c = 0;
+	while ( write( ra->wake[1], &c, 1 ) < 0 && errno == EINTR )
+		;
+
+	pthread_join( ra->thread, 0 );
+	close( ra->wake[0] );
+	close( ra->wake[1] );
+
+	while ( ra->count > 0 ) {
+		read_ahead_push( ss, ra->ring[ra->head] );
+		ra->head = ( ra->head + 1 ) % ra->ring_size;
+		ra->count -= 1;
+	}
+
+	if ( ra->last != 0 )
+		read_ahead_push( ss, ra->last );
+
+	pthread_cond_destroy( &ra->cond );
+	pthread_mutex_destroy( &ra->mutex );
+	free( ra->ring );
+	free( ra );
+	ss->read_ahead = 0;
+}
+
+/* Next block from the ring, waiting for the thread if it is empty. Zero at
+ * the end of the input. */
+static struct run_buf *read_ahead_take( struct colm_program *prg, struct stream_impl_data *ss )
+{
+	struct read_ahead *ra = ss->read_ahead;
+	struct run_buf *rb = 0;
+
+	pthread_mutex_lock( &ra->mutex );
+	while ( ra->count == 0 && !ra->eof )
+		pthread_cond_wait( &ra->cond, &ra->mutex );
+
+	if ( ra->count > 0 ) {
+		rb = ra->ring[ra->head];
+		ra->head = ( ra->head + 1 ) % ra->ring_size;
+		ra->count -= 1;
+		pthread_cond_broadcast( &ra->cond );
+	}
+	pthread_mutex_unlock( &ra->mutex );
+
+	if ( rb != 0 )
+		read_ahead_push( ss, rb );
+
+	return rb;
+}
+
+#else
+
+static void read_ahead_start( struct stream_impl_data *ss, int ring_size ) {}
+static void read_ahead_stop( struct colm_program *prg, struct stream_impl_data *ss ) {}
+static struct run_buf *read_ahead_take( struct colm_program *prg, struct stream_impl_data *ss ) { return 0; }
+
+#endif
+
+/* Read the next block from the source onto the tail of the queue. Unless the
+ * block size is fixed, the size doubles while a source that can grow its
+ * reads fills whole blocks. Pipes, terminals and sockets keep FSM_BUFSIZE,
+ * since fread fills whole blocks from them too, only later. */
+static struct run_buf *data_read_block( struct colm_program *prg, struct stream_impl_data *ss )
+{
+	if ( ss->read_ahead != 0 )
+		return read_ahead_take( prg, ss );
+
+	int size = ss->block_size > 0 ? ss->block_size : ss->read_size;
+
+	struct run_buf *run_buf = new_run_buf( prg, size );
+	int received = ss->funcs->get_data_source( prg, (struct stream_impl*)ss, run_buf->data, size );
+
+	ss->counters.run_bufs += 1;
+	ss->counters.reads += 1;
+	ss->counters.bytes_read += received;
+
+	if ( ss->block_size == 0 && ss->grow_reads &&
+			received == size && size < FSM_BUFSIZE_MAX )
+		ss->read_size = size * 2;
+
+	if ( received == 0 ) {
+		free_run_buf( prg, run_buf );
+		return 0;
+	}
+
+	run_buf->length = received;
+	si_data_push_tail( ss, run_buf );
+	return run_buf;
+}
+
 static int data_get_data( struct colm_program *prg, struct stream_impl_data *ss, char *dest, int length )
 {
 	int copied = 0;
+	int pieces = 0;
 
 	/* Move over skip bytes. */
 	struct run_buf *buf = ss->queue.head;
 	while ( true ) {
 		if ( buf == 0 ) {
 			/* Got through the in-mem buffers without copying anything. */
-			struct run_buf *run_buf = new_run_buf( 0 );
-			int received = ss->funcs->get_data_source( prg, (struct stream_impl*)ss, run_buf->data, FSM_BUFSIZE );
-			if ( received == 0 ) {
-				free( run_buf );
+			buf = data_read_block( prg, ss );
+			if ( buf == 0 )
 				break;
-			}
-
-			run_buf->length = received;
-			si_data_push_tail( ss, run_buf );
-
-			buf = run_buf;
 		}
 
 		int avail = buf->length - buf->offset;
@@ -252,6 +736,7 @@ static int data_get_data( struct colm_program *prg, struct stream_impl_data *ss,
 			memcpy( dest+copied, src, slen ) ;
 			copied += slen;
 			length -= slen;
+			pieces += 1;
 		}
 
 		if ( length == 0 ) {
@@ -262,6 +747,9 @@ static int data_get_data( struct colm_program *prg, struct stream_impl_data *ss,
 		buf = buf->next;
 	}
 
+	if ( pieces > 1 )
+		ss->counters.crossing_buffers += 1;
+
 	return copied;
 }
 
@@ -279,10 +767,11 @@ static struct stream_impl *data_split_consumed( program_t *prg, struct stream_im
 int data_append_data( struct colm_program *prg, struct stream_impl_data *sid, const char *data, int length )
 {
 	struct run_buf *tail = sid->queue.tail;
-	if ( tail == 0 || length > (FSM_BUFSIZE - tail->length) ) {
+	if ( tail == 0 || length > (tail->size - tail->length) ) {
 		debug( prg, REALM_INPUT, "data_append_data: allocating run buf\n" );
-		tail = new_run_buf( length );
+		tail = new_run_buf( prg, length );
 		si_data_push_tail( sid, tail );
+		sid->counters.run_bufs += 1;
 	}
 
 	debug( prg, REALM_INPUT, "data_append_data: appending to "
@@ -304,29 +793,32 @@ int data_undo_append_data( struct colm_program *prg, struct stream_impl_data *si
 	int consumed = 0;
 	int remaining = length;
 
-	/* Move over skip bytes. */
-	while ( true ) {
+	while ( remaining > 0 && sid->queue.tail != 0 ) {
 		struct run_buf *buf = sid->queue.tail;
 
-		if ( buf == 0 )
-			break;
-
 		/* Anything available in the current buffer. */
 		int avail = buf->length - buf->offset;
-		if ( avail > 0 ) {
-			/* The source data from the current buffer. */
-			int slen = avail <= remaining ? avail : remaining;
-			consumed += slen;
-			remaining -= slen;
-			buf->length -= slen;
-			//sid->consumed += slen;
-		}
+		int slen = avail <= remaining ? avail : remaining;
+		consumed += slen;
+		remaining -= slen;
 
-		if ( remaining == 0 )
+		if ( remaining == 0 && buf->refs == 0 ) {
+			buf->length -= slen;
 			break;
+		}
 
-		struct run_buf *run_buf = si_data_pop_tail( sid );
-		free( run_buf );
+		/* Tokens sent back may point into the bytes going away, which the
+		 * next append would write over. Retire the buffer instead, and move
+		 * what stays to a new one. */
+		si_data_pop_tail( sid );
+		if ( slen < avail ) {
+			struct run_buf *rest = new_run_buf( prg, avail - slen );
+			memcpy( rest->data, buf->data + buf->offset, avail - slen );
+			rest->length = avail - slen;
+			si_data_push_tail( sid, rest );
+			sid->counters.run_bufs += 1;
+		}
+		free_run_buf( prg, buf );
 	}
 
 	debug( prg, REALM_INPUT, "data_undo_append_data: stream %p "
@@ -340,10 +832,121 @@ int data_undo_append_data( struct colm_program *prg, struct stream_impl_data *si
 
 }
 
+/*
+ * Output. Printing a tree hands over every token, ignore and indent
+ * separately. File streams collect them in a buffer that goes out in one
+ * write. Large fragments are not copied but go out with the buffer in one
+ * writev.
+ */
+
+static void out_write( struct stream_impl_data *si, const char *data, int length )
+{
+#if defined(HAVE_SYS_UIO_H)
+	struct iovec iov[2];
+	int n = 0;
+
+	if ( si->out_len > 0 ) {
+		iov[n].iov_base = si->out_buf;
+		iov[n].iov_len = si->out_len;
+		n += 1;
+	}
+	if ( length > 0 ) {
+		iov[n].iov_base = (char*)data;
+		iov[n].iov_len = length;
+		n += 1;
+	}
+
+	/* Anything written to the file through stdio goes first. */
+	fflush( si->file );
+
+	int fd = fileno( si->file );
+	struct iovec *v = iov;
+	while ( n > 0 ) {
+		ssize_t written = writev( fd, v, n );
+		if ( written < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			break;
+		}
+
+		/* Step over what went out, which may end inside an iovec. */
+		while ( n > 0 && (size_t)written >= v->iov_len ) {
+			written -= v->iov_len;
+			v += 1;
+			n -= 1;
+		}
+		if ( n > 0 ) {
+			v->iov_base = (char*)v->iov_base + written;
+			v->iov_len -= written;
+		}
+	}
+#else
+	fwrite( si->out_buf, 1, si->out_len, si->file );
+	fwrite( data, 1, length, si->file );
+#endif
+
+	si->out_len = 0;
+}
+
+static void out_flush( struct stream_impl_data *si )
+{
+	if ( si->out_len > 0 )
+		out_write( si, 0, 0 );
+}
+
+void stream_impl_write( struct stream_impl_data *si, const char *data, int length )
+{
+	if ( si->out_buf == 0 ) {
+		if ( !si->out_direct ) {
+			int fd = fileno( si->file );
+			if ( fd == 2 || isatty( fd ) )
+				si->out_direct = 1;
+			else
+				si->out_buf = (char*) malloc( OUT_BUF_SIZE );
+		}
+
+		if ( si->out_direct ) {
+			fwrite( data, 1, length, si->file );
+			return;
+		}
+	}
+
+	if ( length >= OUT_DIRECT )
+		out_write( si, data, length );
+	else {
+		if ( length > OUT_BUF_SIZE - si->out_len )
+			out_flush( si );
+
+		memcpy( si->out_buf + si->out_len, data, length );
+		si->out_len += length;
+	}
+}
+
+void colm_add_input_counters( struct colm_input_counters *dest,
+		const struct colm_input_counters *src )
+{
+	dest->bytes_read += src->bytes_read;
+	dest->reads += src->reads;
+	dest->run_bufs += src->run_bufs;
+	dest->undo_bytes += src->undo_bytes;
+	dest->copied_bytes += src->copied_bytes;
+	dest->crossing_buffers += src->crossing_buffers;
+	dest->crossing_sources += src->crossing_sources;
+}
+
 static void data_destructor( program_t *prg, tree_t **sp, struct stream_impl_data *si )
 {
-	if ( si->file != 0 )
+	read_ahead_stop( prg, si );
+
+	colm_add_input_counters( &prg->input_counters, &si->counters );
+
+	if ( si->file != 0 ) {
+		out_flush( si );
 		close_stream_file( si->file );
+	}
+
+	if ( si->out_buf != 0 )
+		free( si->out_buf );
 	
 	if ( si->collect != 0 ) {
 		str_collect_destroy( si->collect );
@@ -353,7 +956,7 @@ static void data_destructor( program_t *prg, tree_t **sp, struct stream_impl_dat
 	struct run_buf *buf = si->queue.head;
 	while ( buf != 0 ) {
 		struct run_buf *next = buf->next;
-		free( buf );
+		free_run_buf( prg, buf );
 		buf = next;
 	}
 
@@ -362,6 +965,9 @@ static void data_destructor( program_t *prg, tree_t **sp, struct stream_impl_dat
 	if ( si->data != 0 )
 		free( (char*)si->data );
 
+	if ( si->line_len != 0 )
+		free( si->line_len );
+
 	/* FIXME: Need to leak this for now. Until we can return strings to a
 	 * program loader and free them at a later date (after the colm program is
 	 * deleted). */
@@ -378,13 +984,18 @@ static str_collect_t *data_get_collect( struct colm_program *prg, struct stream_
 
 static void data_flush_stream( struct colm_program *prg, struct stream_impl_data *si )
 {
-	if ( si->file != 0 )
+	if ( si->file != 0 ) {
+		out_flush( si );
 		fflush( si->file );
+	}
 }
 
 static void data_close_stream( struct colm_program *prg, struct stream_impl_data *si )
 {
+	read_ahead_stop( prg, si );
+
 	if ( si->file != 0 ) {
+		out_flush( si );
 		close_stream_file( si->file );
 		si->file = 0;
 	}
@@ -392,12 +1003,38 @@ static void data_close_stream( struct colm_program *prg, struct stream_impl_data
 
 static int data_get_option( struct colm_program *prg, struct stream_impl_data *si, int option )
 {
+	if ( option == STREAM_OPT_BLOCK_SIZE )
+		return si->block_size;
+	if ( option == STREAM_OPT_READ_AHEAD )
+		return si->read_ahead != 0;
 	return si->auto_trim;
 }
 
 static void data_set_option( struct colm_program *prg, struct stream_impl_data *si, int option, int value )
 {
-	si->auto_trim = value ? 1 : 0;
+	if ( option == STREAM_OPT_BLOCK_SIZE ) {
+		/* Zero or less goes back to adapting. */
+		if ( value <= 0 )
+			si->block_size = 0;
+		else
+			si->block_size = value < FSM_BUFSIZE_MAX ? value : FSM_BUFSIZE_MAX;
+	}
+	else if ( option == STREAM_OPT_READ_AHEAD ) {
+		/* Value is the number of blocks to read ahead. */
+		if ( value > 0 )
+			read_ahead_start( si, value );
+		else
+			read_ahead_stop( prg, si );
+	}
+	else {
+		si->auto_trim = value ? 1 : 0;
+	}
+}
+
+static void data_commit_consumed( struct colm_program *prg, struct stream_impl_data *si, long keep )
+{
+	if ( si->line_len != 0 )
+		stream_impl_trim_lines( si, keep );
 }
 
 static void data_print_tree( struct colm_program *prg, tree_t **sp,
@@ -414,25 +1051,31 @@ static int data_get_parse_block( struct colm_program *prg, struct stream_impl_da
 	int ret = 0;
 	*copied = 0;
 
-	/* Move over skip bytes. */
+	/* Resume from the last block if the scanner is past it, rather than
+	 * walking the whole token again. */
 	struct run_buf *buf = ss->queue.head;
+	long base = 0;
+	if ( ss->scan_buf != 0 && *pskip >= ss->scan_base ) {
+		buf = ss->scan_buf;
+		base = ss->scan_base;
+		*pskip -= base;
+	}
+
+	/* Move over skip bytes. */
 	while ( true ) {
 		if ( buf == 0 ) {
 			/* Got through the in-mem buffers without copying anything. */
-			struct run_buf *run_buf = new_run_buf( 0 );
-			int received = ss->funcs->get_data_source( prg, (struct stream_impl*)ss, run_buf->data, FSM_BUFSIZE );
-			if ( received == 0 ) {
-				free( run_buf );
+			struct run_buf *run_buf = data_read_block( prg, ss );
+			if ( run_buf == 0 ) {
 				ret = INPUT_EOD;
 				break;
 			}
 
-			run_buf->length = received;
-			si_data_push_tail( ss, run_buf );
+			ss->scan_buf = run_buf;
+			ss->scan_base = base;
 
-			int slen = received;
 			*pdp = run_buf->data;
-			*copied = slen;
+			*copied = run_buf->length;
 			ret = INPUT_DATA;
 			break;
 		}
@@ -448,8 +1091,12 @@ static int data_get_parse_block( struct colm_program *prg, struct stream_impl_da
 			if ( *pskip > 0 && *pskip >= avail ) {
 				/* Skipping the the whole source. */
 				*pskip -= avail;
+				base += avail;
 			}
 			else {
+				ss->scan_buf = buf;
+				ss->scan_base = base;
+
 				/* Either skip is zero, or less than slen. Skip goes to zero.
 				 * Some data left over, copy it. */
 				src += *pskip;
@@ -475,6 +1122,9 @@ static int data_consume_data( struct colm_program *prg, struct stream_impl_data
 	int consumed = 0;
 	int remaining = length;
 
+	sid->scan_buf = 0;
+	start_line_index( prg, sid );
+
 	/* Move over skip bytes. */
 	while ( true ) {
 		struct run_buf *buf = sid->queue.head;
@@ -493,7 +1143,7 @@ static int data_consume_data( struct colm_program *prg, struct stream_impl_data
 			int slen = avail <= remaining ? avail : remaining;
 			consumed += slen;
 			remaining -= slen;
-			update_position_data( sid, buf->data + buf->offset, slen );
+			consume_position( prg, sid, buf->data + buf->offset, slen );
 			buf->offset += slen;
 			sid->consumed += slen;
 		}
@@ -502,7 +1152,7 @@ static int data_consume_data( struct colm_program *prg, struct stream_impl_data
 			break;
 
 		struct run_buf *run_buf = si_data_pop_head( sid );
-		free( run_buf );
+		free_run_buf( prg, run_buf );
 	}
 
 	debug( prg, REALM_INPUT, "data_consume_data: stream %p "
@@ -523,25 +1173,32 @@ static int data_undo_consume_data( struct colm_program *prg, struct stream_impl_
 		amount = sid->consumed;
 
 	int remaining = amount;
+	sid->scan_buf = 0;
+	sid->counters.undo_bytes += amount;
 	struct run_buf *head = sid->queue.head;
 	if ( head != 0 && head->offset > 0 ) {
-		/* Fill into the offset space. */
+		/* Fill into the offset space. Tokens may point at it, so if it is
+		 * pinned only the same text can go back. */
 		int fill = remaining > head->offset ? head->offset : remaining;
-		end -= fill;
-		remaining -= fill;
+		char *dest = head->data + (head->offset - fill);
+		if ( head->refs == 0 || memcmp( dest, end - fill, fill ) == 0 ) {
+			end -= fill;
+			remaining -= fill;
 
-		undo_position_data( sid, end, fill );
-		memcpy( head->data + (head->offset - fill), end, fill );
+			undo_consume_position( prg, sid, end, fill );
+			memmove( dest, end, fill );
 
-		head->offset -= fill;
-		sid->consumed -= fill;
+			head->offset -= fill;
+			sid->consumed -= fill;
+		}
 	}
 
 	if ( remaining > 0 ) {
 		end -= remaining;
-		struct run_buf *new_buf = new_run_buf( 0 );
+		struct run_buf *new_buf = new_run_buf( prg, remaining );
 		new_buf->length = remaining;
-		undo_position_data( sid, end, remaining );
+		sid->counters.run_bufs += 1;
+		undo_consume_position( prg, sid, end, remaining );
 		memcpy( new_buf->data, end, remaining );
 		si_data_push_head( sid, new_buf );
 		sid->consumed -= amount;
@@ -557,6 +1214,22 @@ static int data_undo_consume_data( struct colm_program *prg, struct stream_impl_
 	return amount;
 }
 
+/* Tokens that lie within one buffer point into it instead of being copied
+ * out. The buffer is returned so the token can pin it. Buffers from short
+ * reads are mostly empty space, so tokens in them are still copied. */
+static const char *data_get_data_ptr( struct colm_program *prg, struct stream_impl_data *ss, int length, struct run_buf **prb )
+{
+	struct run_buf *buf = ss->queue.head;
+	while ( buf != 0 && buf->offset == buf->length )
+		buf = buf->next;
+
+	if ( buf != 0 && buf->length - buf->offset >= length && buf->length * 2 >= buf->size ) {
+		*prb = buf;
+		return buf->data + buf->offset;
+	}
+	return 0;
+}
+
 /*
  * File Inputs
  */
@@ -566,6 +1239,168 @@ static int file_get_data_source( struct colm_program *prg, struct stream_impl_da
 	return fread( dest, 1, length, si->file );
 }
 
+/*
+ * Mapped file inputs. The scanner and extracted tokens use the mapping
+ * directly. Text that is sent back normally just rewinds the offset. Only if
+ * it differs from the mapping does it go into the queue, which is then read
+ * ahead of the mapping.
+ */
+
+void colm_file_mapping_delete( struct file_mapping *fm )
+{
+#if defined(HAVE_SYS_MMAN_H)
+	munmap( fm->data, fm->length );
+#endif
+	free( fm );
+}
+
+static int mmap_get_parse_block( struct colm_program *prg, struct stream_impl_data *ss, int *pskip, char **pdp, int *copied )
+{
+	*copied = 0;
+
+	struct run_buf *buf = ss->queue.head;
+	while ( buf != 0 ) {
+		int avail = buf->length - buf->offset;
+		if ( avail > 0 ) {
+			if ( *pskip >= avail )
+				*pskip -= avail;
+			else {
+				*pdp = &buf->data[buf->offset] + *pskip;
+				*copied = avail - *pskip;
+				*pskip = 0;
+				return INPUT_DATA;
+			}
+		}
+		buf = buf->next;
+	}
+
+	long avail = ss->dlen - ss->offset;
+	if ( *pskip >= avail ) {
+		*pskip -= avail;
+		return INPUT_EOD;
+	}
+
+	avail -= *pskip;
+	*pdp = (char*)ss->data + ss->offset + *pskip;
+	*copied = avail < MMAP_BLOCK ? avail : MMAP_BLOCK;
+	*pskip = 0;
+	return INPUT_DATA;
+}
+
+static int mmap_get_data( struct colm_program *prg, struct stream_impl_data *ss, char *dest, int length )
+{
+	int copied = 0;
+
+	struct run_buf *buf = ss->queue.head;
+	while ( buf != 0 && length > 0 ) {
+		int avail = buf->length - buf->offset;
+		int slen = avail < length ? avail : length;
+		memcpy( dest + copied, &buf->data[buf->offset], slen );
+		copied += slen;
+		length -= slen;
+		buf = buf->next;
+	}
+
+	long avail = ss->dlen - ss->offset;
+	int slen = avail < length ? avail : length;
+	memcpy( dest + copied, ss->data + ss->offset, slen );
+
+	/* Text sent back and the mapping. */
+	if ( copied > 0 && slen > 0 )
+		ss->counters.crossing_buffers += 1;
+
+	copied += slen;
+
+	return copied;
+}
+
+static const char *mmap_get_data_ptr( struct colm_program *prg, struct stream_impl_data *ss, int length, struct run_buf **prb )
+{
+	if ( ss->queue.head == 0 && ss->dlen - ss->offset >= length ) {
+		*prb = ss->mapping;
+		return ss->data + ss->offset;
+	}
+	return 0;
+}
+
+static int mmap_consume_data( struct colm_program *prg, struct stream_impl_data *sid, int length, location_t *loc )
+{
+	int consumed = 0;
+	int remaining = length;
+
+	start_line_index( prg, sid );
+
+	while ( remaining > 0 && sid->queue.head != 0 ) {
+		struct run_buf *buf = sid->queue.head;
+		int avail = buf->length - buf->offset;
+		if ( avail > 0 ) {
+			if ( !loc_set( loc ) )
+				data_transfer_loc( prg, loc, sid );
+
+			int slen = avail <= remaining ? avail : remaining;
+			consumed += slen;
+			remaining -= slen;
+			consume_position( prg, sid, buf->data + buf->offset, slen );
+			buf->offset += slen;
+			sid->consumed += slen;
+		}
+
+		if ( buf->offset == buf->length )
+			free_run_buf( prg, si_data_pop_head( sid ) );
+	}
+
+	long avail = sid->dlen - sid->offset;
+	if ( remaining > 0 && avail > 0 ) {
+		if ( !loc_set( loc ) )
+			data_transfer_loc( prg, loc, sid );
+
+		int slen = avail <= remaining ? avail : remaining;
+		consumed += slen;
+		consume_position( prg, sid, sid->data + sid->offset, slen );
+		sid->offset += slen;
+		sid->consumed += slen;
+	}
+
+	debug( prg, REALM_INPUT, "mmap_consume_data: stream %p "
+			"ask: %d, consumed: %d, now: %d\n", sid, length, consumed, sid->consumed );
+
+	return consumed;
+}
+
+static int mmap_undo_consume_data( struct colm_program *prg, struct stream_impl_data *sid, const char *data, int length )
+{
+	int amount = length;
+	if ( amount > sid->consumed )
+		amount = sid->consumed;
+
+	const char *start = data + length - amount;
+	const char *back = sid->data + sid->offset - amount;
+	if ( sid->queue.head == 0 && amount <= sid->offset &&
+			( start == back || memcmp( start, back, amount ) == 0 ) )
+	{
+		undo_consume_position( prg, sid, back, amount );
+		sid->offset -= amount;
+		sid->consumed -= amount;
+		sid->counters.undo_bytes += amount;
+
+		debug( prg, REALM_INPUT, "mmap_undo_consume_data: stream %p "
+				"rewound %d of %d bytes, consumed now %d, \n", sid, amount, length, sid->consumed );
+
+		return amount;
+	}
+
+	return data_undo_consume_data( prg, sid, data, length );
+}
+
+static void mmap_destructor( program_t *prg, tree_t **sp, struct stream_impl_data *si )
+{
+	/* Unmapped now, or by the last token pointing into it. */
+	struct run_buf *mapping = si->mapping;
+	si->data = 0;
+	data_destructor( prg, sp, si );
+	free_run_buf( prg, mapping );
+}
+
 /*
  * Text inputs
  */
@@ -612,6 +1447,36 @@ struct stream_funcs_data file_funcs =
 
 	&data_get_option,
 	&data_set_option,
+
+	&data_get_data_ptr,
+	&data_commit_consumed,
+};
+
+struct stream_funcs_data mmap_funcs = 
+{
+	&mmap_get_parse_block,
+	&mmap_get_data,
+	&accum_get_data_source,
+
+	&mmap_consume_data,
+	&mmap_undo_consume_data,
+
+	&data_transfer_loc,
+	&data_get_collect,
+	&data_flush_stream,
+	&data_close_stream,
+	&data_print_tree,
+
+	&data_split_consumed,
+	&data_append_data,
+	&data_undo_append_data,
+	&mmap_destructor,
+
+	&data_get_option,
+	&data_set_option,
+
+	&mmap_get_data_ptr,
+	&data_commit_consumed,
 };
 
 struct stream_funcs_data accum_funcs = 
@@ -636,6 +1501,9 @@ struct stream_funcs_data accum_funcs =
 
 	&data_get_option,
 	&data_set_option,
+
+	&data_get_data_ptr,
+	&data_commit_consumed,
 };
 
 static void si_data_init( struct stream_impl_data *is, char *name )
@@ -648,6 +1516,9 @@ static void si_data_init( struct stream_impl_data *is, char *name )
 	is->column = 1;
 	is->byte = 0;
 
+	is->read_size = FSM_BUFSIZE;
+	is->grow_reads = 1;
+
 	/* Indentation turned off. */
 	is->indent.level = COLM_INDENT_OFF;
 	is->indent.indent = 0;
@@ -662,21 +1533,68 @@ struct stream_impl *colm_impl_new_accum( char *name )
 	return (struct stream_impl*)si;
 }
 
+/* Only regular files can have reads grow with the input. */
+static int file_grows_reads( FILE *file )
+{
+	struct stat st;
+	return file != 0 && fstat( fileno( file ), &st ) == 0 && S_ISREG( st.st_mode );
+}
+
 static struct stream_impl *colm_impl_new_file( char *name, FILE *file )
 {
 	struct stream_impl_data *ss = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
 	si_data_init( ss, name );
 	ss->funcs = (struct stream_funcs*)&file_funcs;
 	ss->file = file;
+	ss->grow_reads = file_grows_reads( file );
 	return (struct stream_impl*)ss;
 }
 
+static struct stream_impl *colm_impl_new_mmap( program_t *prg, char *name, struct file_mapping *fm )
+{
+	struct stream_impl_data *si = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
+	si_data_init( si, name );
+	si->funcs = (struct stream_funcs*)&mmap_funcs;
+	si->data = fm->data;
+	si->dlen = fm->length;
+	si->mapping = new_run_buf( prg, 0 );
+	si->mapping->file_mapping = fm;
+	return (struct stream_impl*)si;
+}
+
+/* Map a regular file for reading. Returns zero if it cannot be mapped, in
+ * which case it is read through the file. Stream offsets and consumed counts
+ * are ints, so files larger than INT_MAX are also read through the file. */
+static struct file_mapping *map_file( program_t *prg, FILE *file )
+{
+#if defined(HAVE_SYS_MMAN_H)
+	struct stat st;
+	if ( fstat( fileno( file ), &st ) != 0 || !S_ISREG( st.st_mode ) ||
+			st.st_size == 0 || st.st_size > INT_MAX )
+		return 0;
+
+	void *data = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fileno( file ), 0 );
+	if ( data == MAP_FAILED )
+		return 0;
+
+	madvise( data, st.st_size, MADV_SEQUENTIAL );
+
+	struct file_mapping *fm = (struct file_mapping*) malloc( sizeof(struct file_mapping) );
+	fm->data = (char*)data;
+	fm->length = st.st_size;
+	return fm;
+#else
+	return 0;
+#endif
+}
+
 static struct stream_impl *colm_impl_new_fd( char *name, long fd )
 {
 	struct stream_impl_data *si = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
 	si_data_init( si, name );
 	si->funcs = (struct stream_funcs*)&file_funcs;
 	si->file = fdopen( fd, ( fd == 0 ) ? "r" : "w" );
+	si->grow_reads = file_grows_reads( si->file );
 	return (struct stream_impl*)si;
 }
 
@@ -767,8 +1685,18 @@ stream_t *colm_stream_open_file( program_t *prg, tree_t *name, tree_t *mode )
 
 	FILE *file = fopen( file_name, fopen_mode );
 	if ( file != 0 ) {
+		struct file_mapping *fm = 0;
+		if ( fopen_mode[0] == 'r' )
+			fm = map_file( prg, file );
+
 		stream = colm_stream_new_struct( prg );
-		stream->impl = colm_impl_new_file( colm_filename_add( prg, file_name ), file );
+		if ( fm != 0 ) {
+			stream->impl = colm_impl_new_mmap( prg, colm_filename_add( prg, file_name ), fm );
+			fclose( file );
+		}
+		else {
+			stream->impl = colm_impl_new_file( colm_filename_add( prg, file_name ), file );
+		}
 	}
 
 	free( file_name );
@@ -66,8 +66,10 @@ head_t *string_copy( program_t *prg, head_t *head )
 	if ( head != 0 ) {
 		if ( (char*)(head+1) == head->data )
 			result = string_alloc_full( prg, head->data, head->length );
-		else
+		else {
 			result = colm_string_alloc_pointer( prg, head->data, head->length );
+			string_pin( result, head->run_buf );
+		}
 
 		if ( head->location != 0 ) {
 			result->location = location_allocate( prg );
@@ -75,6 +77,7 @@ head_t *string_copy( program_t *prg, head_t *head )
 			result->location->line = head->location->line;
 			result->location->column = head->location->column;
 			result->location->byte = head->location->byte;
+			result->location->line_index = head->location->line_index;
 		}
 	}
 	return result;
@@ -86,6 +89,9 @@ void string_free( program_t *prg, head_t *head )
 		if ( head->location != 0 )
 			location_free( prg, head->location );
 
+		if ( head->run_buf != 0 )
+			colm_run_buf_unpin( prg, head->run_buf );
+
 		if ( (char*)(head+1) == head->data ) {
 			/* Full string allocation. */
 			free( head );
@@ -126,6 +132,7 @@ head_t *init_str_space( long length )
 	head->data = (char*)(head+1);
 	head->length = length;
 	head->location = 0;
+	head->run_buf = 0;
 
 	/* Save the pointer to the data. */
 	return head;
@@ -156,6 +163,14 @@ head_t *colm_string_alloc_pointer( program_t *prg, const char *data, long length
 	return head;
 }
 
+/* Keep the input buffer the data points into alive for the head. */
+void string_pin( head_t *head, struct run_buf *run_buf )
+{
+	head->run_buf = run_buf;
+	if ( run_buf != 0 )
+		run_buf->refs += 1;
+}
+
 head_t *concat_str( head_t *s1, head_t *s2 )
 {
 	long s1Len = s1->length;
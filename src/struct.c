@@ -49,6 +49,21 @@ void colm_struct_add( program_t *prg, struct colm_struct *item )
 	}
 }
 
+void colm_struct_detach( program_t *prg, struct colm_struct *item )
+{
+	if ( item->prev == 0 )
+		prg->heap.head = item->next;
+	else
+		item->prev->next = item->next;
+
+	if ( item->next == 0 )
+		prg->heap.tail = item->prev;
+	else
+		item->next->prev = item->prev;
+
+	item->prev = item->next = 0;
+}
+
 struct colm_struct *colm_struct_new_size( program_t *prg, int size )
 {
 	size_t memsize = sizeof(struct colm_struct) + ( sizeof(tree_t*) * size );
@@ -1596,7 +1596,9 @@ static location_t *loc_search( program_t *prg, tree_t *tree )
 
 struct colm_location *colm_find_location( program_t *prg, tree_t *tree )
 {
-	return loc_search( prg, tree );
+	location_t *loc = loc_search( prg, tree );
+	colm_location_resolve( loc );
+	return loc;
 }
 
 head_t *tree_to_str( program_t *prg, tree_t **sp, tree_t *tree, int trim, int attrs )
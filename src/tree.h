@@ -57,6 +57,9 @@ typedef struct colm_location
 	long line;
 	long column;
 	long byte;
+
+	/* When set, line and column are not yet computed. */
+	struct line_index *line_index;
 } location_t;
 
 /* Header located just before string data. */
@@ -65,6 +68,9 @@ typedef struct colm_data
 	const char *data; 
 	long length;
 	struct colm_location *location;
+
+	/* Input buffer the data points into, pinned while the head lives. */
+	struct run_buf *run_buf;
 } head_t;
 
 typedef struct colm_kid